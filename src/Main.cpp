@@ -25,6 +25,8 @@
 #include <time.h>
 #include <math.h>
 #include <string>
+#include <chrono>
+#include <algorithm>
 
 #include "SDL2/SDL.h"
 #include "GL/gl3w.h"
@@ -34,9 +36,21 @@
 #include "ImGuizmo.h"
 #include "tinydir.h"
 
+#if !defined(_WIN32) && !defined(__APPLE__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
 #include "Scene.h"
 #include "Loader.h"
 #include "GLTFLoader.h"
+#include "SceneLoader.h"
 #include "Renderer.h"
 #include "boyTestScene.h"
 #include "ajaxTestScene.h"
@@ -52,6 +66,7 @@ using namespace GLSLPT;
 
 Scene* scene = nullptr;
 Renderer* renderer = nullptr;
+SceneLoader* sceneLoader = nullptr;
 
 std::vector<string> sceneFiles;
 std::vector<string> envMaps;
@@ -59,12 +74,36 @@ std::vector<string> envMaps;
 float mouseSensitivity = 0.01f;
 bool keyPressed = false;
 int sampleSceneIdx = 0;
+bool sceneChanged = false;
+
+// Snapshot to write once the current scene has been processed. Empty if it was restored from one
+std::string snapshotFile;
+unsigned long long snapshotHash = 0;
 int selectedInstance = 0;
 double lastTime = SDL_GetTicks();
 int envMapIdx = 0;
 bool done = false;
 
+// Batch rendering without a window or UI
+bool headless = false;
+int headlessSpp = 0;
+int headlessSampleOffset = -1;
+std::string outputFile = "output.png";
+
+// Partial accumulations from sample range renders, merged into one image
+std::string mergeOutput;
+std::vector<std::string> mergeInputs;
+
+// Periodic checkpoints of the accumulation, so long renders can be resumed
+std::string checkpointFile;
+std::string resumeFile;
+float checkpointInterval = 300.0f;
+std::chrono::steady_clock::time_point lastCheckpointTime = std::chrono::steady_clock::now();
+
 std::string shadersDir = "../src/shaders/";
+std::string shaderCacheDir = "shadercache/";
+std::string sceneCacheDir = "scenecache/";
+bool sceneCacheHashContents = false; // Key snapshots on the full contents of the source files, not their size and time
 std::string assetsDir = "../assets/";
 std::string envMapDir = "../assets/HDR/";
 
@@ -120,8 +159,15 @@ void GetEnvMaps()
 
 void LoadScene(std::string sceneName)
 {
+    // The renderer is created again once the meshes of the new scene are loaded
+    delete sceneLoader;
+    sceneLoader = nullptr;
+    delete renderer;
+    renderer = nullptr;
+
     delete scene;
     scene = new Scene();
+    scene->deferLoading = true;
     std::string ext = sceneName.substr(sceneName.find_last_of(".") + 1);
 
     bool success = false;
@@ -152,24 +198,147 @@ void LoadScene(std::string sceneName)
     }
 
     scene->renderOptions = renderOptions;
+
+    // A snapshot of the processed scene replaces reading and processing the meshes and textures
+    snapshotFile.clear();
+    if (!sceneCacheDir.empty())
+    {
+        unsigned long long sourceHash = SceneSnapshot::SourceHash(sceneName, scene, sceneCacheHashContents);
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", sourceHash);
+
+        scene->snapshot = SceneSnapshot::Map(sceneCacheDir + name, sourceHash);
+        if (scene->snapshot)
+        {
+            printf("Using scene snapshot %s%s\n", sceneCacheDir.c_str(), name);
+            return;
+        }
+
+        snapshotFile = sceneCacheDir + name;
+        snapshotHash = sourceHash;
+    }
+
+    // Meshes and textures are read in the background
+    sceneLoader = new SceneLoader(scene);
+}
+
+void WriteSceneSnapshot()
+{
+    if (snapshotFile.empty())
+        return;
+
+    if (SceneSnapshot::Write(snapshotFile, snapshotHash, scene))
+        printf("Wrote scene snapshot %s\n", snapshotFile.c_str());
+    snapshotFile.clear();
 }
 
 bool InitRenderer()
 {
     delete renderer;
-    renderer = new Renderer(scene, shadersDir);
+    renderer = new Renderer(scene, shadersDir, shaderCacheDir);
     return true;
 }
 
-void SaveFrame(const std::string filename)
+// The renderer is first created once the meshes are loaded and shows the scene with placeholder textures.
+// It is created again when the textures have been decoded
+void EndSceneLoad()
 {
-    unsigned char* data = nullptr;
-    int w, h;
-    renderer->GetOutputBuffer(&data, w, h);
-    stbi_flip_vertically_on_write(true);
-    stbi_write_png(filename.c_str(), w, h, 4, data, w * 4);
-    printf("Frame saved: %s\n", filename.c_str());
-    delete[] data;
+    // The mesh and material IDs of the scene file no longer match if files were dropped
+    if (sceneLoader->NumFailed() > 0)
+        snapshotFile.clear();
+
+    delete sceneLoader;
+    sceneLoader = nullptr;
+}
+
+void UpdateSceneLoad()
+{
+    if (renderer && !sceneLoader)
+        return;
+
+    if (!renderer && (!sceneLoader || sceneLoader->MeshesLoaded()))
+    {
+        if (sceneLoader)
+        {
+            sceneLoader->FinishMeshes();
+            if (sceneLoader->TexturesLoaded())
+            {
+                sceneLoader->FinishTextures();
+                EndSceneLoad();
+            }
+        }
+        scene->renderOptions = renderOptions;
+        InitRenderer();
+    }
+    else if (renderer && sceneLoader->TexturesLoaded())
+    {
+        sceneLoader->FinishTextures();
+        EndSceneLoad();
+        scene->renderOptions = renderOptions;
+        InitRenderer();
+    }
+
+    if (!sceneLoader)
+    {
+        WriteSceneSnapshot();
+
+        // Only the complete scene can continue a previous render
+        if (!resumeFile.empty())
+        {
+            renderer->LoadCheckpoint(resumeFile);
+            resumeFile.clear();
+        }
+    }
+}
+
+void FinishSceneLoad()
+{
+    if (!sceneLoader)
+        return;
+
+    sceneLoader->Wait();
+    sceneLoader->FinishMeshes();
+    sceneLoader->FinishTextures();
+    EndSceneLoad();
+}
+
+void ShowLoadingScreen(LoopData& loopdata)
+{
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplSDL2_NewFrame(loopdata.mWindow);
+    ImGui::NewFrame();
+
+    ImGui::Begin("Loading");
+    int numLoaded = sceneLoader->NumLoaded();
+    int numAssets = sceneLoader->NumAssets();
+    std::string progress = to_string(numLoaded) + " / " + to_string(numAssets);
+    ImGui::ProgressBar(numAssets > 0 ? (float)numLoaded / numAssets : 1.0f, ImVec2(-1.0f, 0.0f), progress.c_str());
+    ImGui::End();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, renderOptions.windowResolution.x, renderOptions.windowResolution.y);
+    glClearColor(0., 0., 0., 0.);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    SDL_GL_SwapWindow(loopdata.mWindow);
+
+    // Leave the cores to the loader
+    SDL_Delay(15);
+}
+
+void UpdateCheckpoint()
+{
+    if (checkpointFile.empty())
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<float>(now - lastCheckpointTime).count() < checkpointInterval)
+        return;
+
+    // Saving fails while only a preview is shown, in which case it is retried on the next frame
+    if (renderer->SaveCheckpoint(checkpointFile))
+        lastCheckpointTime = now;
 }
 
 void Render()
@@ -286,7 +455,8 @@ void MainLoop(void* arg)
                     renderOptions.renderResolution = renderOptions.windowResolution;
 
                 scene->renderOptions = renderOptions;
-                renderer->ResizeRenderer();
+                if (renderer)
+                    renderer->ResizeRenderer();
             }
 
             if (event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(loopdata.mWindow))
@@ -296,6 +466,25 @@ void MainLoop(void* arg)
         }
     }
 
+    if (sceneChanged)
+    {
+        sceneChanged = false;
+        LoadScene(sceneFiles[sampleSceneIdx]);
+        SDL_RestoreWindow(loopdata.mWindow);
+        SDL_SetWindowSize(loopdata.mWindow, renderOptions.windowResolution.x, renderOptions.windowResolution.y);
+        int w, h;
+        SDL_GL_GetDrawableSize(loopdata.mWindow, &w, &h);
+        renderOptions.windowResolution.x = w;
+        renderOptions.windowResolution.y = h;
+    }
+
+    UpdateSceneLoad();
+    if (!renderer)
+    {
+        ShowLoadingScreen(loopdata);
+        return;
+    }
+
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame(loopdata.mWindow);
     ImGui::NewFrame();
@@ -306,6 +495,8 @@ void MainLoop(void* arg)
         ImGui::Begin("Settings");
 
         ImGui::Text("Samples: %d ", renderer->GetSampleCount());
+        if (sceneLoader)
+            ImGui::Text("Loading textures: %d / %d", sceneLoader->NumLoaded(), sceneLoader->NumAssets());
 
         ImGui::BulletText("LMB + drag to rotate");
         ImGui::BulletText("MMB + drag to pan");
@@ -314,7 +505,13 @@ void MainLoop(void* arg)
 
         if (ImGui::Button("Save Screenshot"))
         {
-            SaveFrame("./img_" + to_string(renderer->GetSampleCount()) + ".png");
+            renderer->SaveOutput("./img_" + to_string(renderer->GetSampleCount()) + ".png");
+        }
+
+        ImGui::SameLine();
+        if (ImGui::Button("Save EXR"))
+        {
+            renderer->SaveOutput("./img_" + to_string(renderer->GetSampleCount()) + ".exr");
         }
 
         // Scenes
@@ -322,17 +519,9 @@ void MainLoop(void* arg)
         for (int i = 0; i < sceneFiles.size(); ++i)
             scenes.push_back(sceneFiles[i].c_str());
 
+        // The scene is switched at the start of the next frame, as the renderer goes away until it's loaded
         if (ImGui::Combo("Scene", &sampleSceneIdx, scenes.data(), scenes.size()))
-        {
-            LoadScene(sceneFiles[sampleSceneIdx]);
-            SDL_RestoreWindow(loopdata.mWindow);
-            SDL_SetWindowSize(loopdata.mWindow, renderOptions.windowResolution.x, renderOptions.windowResolution.y);
-            int w, h;
-            SDL_GL_GetDrawableSize(loopdata.mWindow, &w, &h);
-            renderOptions.windowResolution.x = w;
-            renderOptions.windowResolution.y = h;
-            InitRenderer();
-        }
+            sceneChanged = true;
 
         // Environment maps
         std::vector<const char*> envMapsList;
@@ -352,13 +541,18 @@ void MainLoop(void* arg)
         if (ImGui::CollapsingHeader("Render Settings"))
         {
             optionsChanged |= ImGui::SliderInt("Max Spp", &renderOptions.maxSpp, -1, 256);
+            optionsChanged |= ImGui::SliderInt("Samples Per Pass", &renderOptions.samplesPerPass, 1, 64);
             optionsChanged |= ImGui::SliderInt("Max Depth", &renderOptions.maxDepth, 1, 10);
+            reloadShaders |= ImGui::Combo("Sampler", &renderOptions.sampler, "Random\0Sobol\0Blue Noise\0");
+            ImGui::SliderFloat("Target Frame Time (ms)", &renderOptions.targetFrameTime, 0.0f, 100.0f);
 
             reloadShaders |= ImGui::Checkbox("Enable Russian Roulette", &renderOptions.enableRR);
             reloadShaders |= ImGui::SliderInt("Russian Roulette Depth", &renderOptions.RRDepth, 1, 10);
+            reloadShaders |= ImGui::Checkbox("Efficiency-Aware Russian Roulette", &renderOptions.enableEfficiencyRR);
             reloadShaders |= ImGui::Checkbox("Enable Roughness Mollification", &renderOptions.enableRoughnessMollification);
             optionsChanged |= ImGui::SliderFloat("Roughness Mollification Amount", &renderOptions.roughnessMollificationAmt, 0, 1);
             reloadShaders |= ImGui::Checkbox("Enable Volume MIS", &renderOptions.enableVolumeMIS);
+            reloadShaders |= ImGui::Checkbox("Enable Path Guiding", &renderOptions.enablePathGuiding);
         }
 
         if (ImGui::CollapsingHeader("Environment"))
@@ -393,7 +587,7 @@ void MainLoop(void* arg)
         if (ImGui::CollapsingHeader("Denoiser"))
         {
 
-            ImGui::Checkbox("Enable Denoiser", &renderOptions.enableDenoiser);
+            reloadShaders |= ImGui::Checkbox("Enable Denoiser", &renderOptions.enableDenoiser);
             ImGui::SliderInt("Number of Frames to skip", &renderOptions.denoiserFrameCnt, 5, 50);
         }
 
@@ -442,6 +636,9 @@ void MainLoop(void* arg)
             objectPropChanged |= ImGui::ColorEdit3("Albedo (Gamma Corrected)", (float*)(&albedo), 0);
             mat->baseColor = Vec3::Pow(albedo, 2.2);
 
+            // Unused BSDF lobes are compiled out of the shaders, so rebuild them when one is first switched on
+            Material prevMat = *mat;
+
             objectPropChanged |= ImGui::SliderFloat("Metallic", &mat->metallic, 0.0f, 1.0f);
             objectPropChanged |= ImGui::SliderFloat("Roughness", &mat->roughness, 0.001f, 1.0f);
             objectPropChanged |= ImGui::SliderFloat("SpecularTint", &mat->specularTint, 0.0f, 1.0f);
@@ -454,6 +651,11 @@ void MainLoop(void* arg)
             objectPropChanged |= ImGui::SliderFloat("SpecTrans", &mat->specTrans, 0.0f, 1.0f);
             objectPropChanged |= ImGui::SliderFloat("Ior", &mat->ior, 1.001f, 2.0f);
 
+            reloadShaders |= (prevMat.anisotropic == 0.0f && mat->anisotropic > 0.0f) ||
+                (prevMat.sheen == 0.0f && mat->sheen > 0.0f) ||
+                (prevMat.clearcoat == 0.0f && mat->clearcoat > 0.0f) ||
+                (prevMat.specTrans == 0.0f && mat->specTrans > 0.0f);
+
             int mediumType = (int)mat->mediumType;
             if (ImGui::Combo("Medium Type", &mediumType, "None\0Absorb\0Scatter\0Emissive\0"))
             {
@@ -532,9 +734,146 @@ void MainLoop(void* arg)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glDisable(GL_DEPTH_TEST);
     Render();
+    UpdateCheckpoint();
     SDL_GL_SwapWindow(loopdata.mWindow);
 }
 
+int RenderHeadless()
+{
+#if defined(_WIN32) || defined(__APPLE__)
+    // Render through the context of a hidden window
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    {
+        printf("Error: %s\n", SDL_GetError());
+        return -1;
+    }
+
+#ifdef __APPLE__
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
+#endif
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 2);
+
+    SDL_Window* window = SDL_CreateWindow("GLSL PathTracer", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    SDL_GLContext context = window ? SDL_GL_CreateContext(window) : nullptr;
+    if (!context)
+    {
+        fprintf(stderr, "Failed to initialize GL context!\n");
+        return 1;
+    }
+#else
+    // Surfaceless EGL context, which needs no display server and also runs on Mesa llvmpipe
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    {
+        fprintf(stderr, "Failed to initialize EGL!\n");
+        return 1;
+    }
+
+    EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+    eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    eglBindAPI(EGL_OPENGL_API);
+    EGLContext context = eglCreateContext(display, numConfigs > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        fprintf(stderr, "Failed to initialize GL context!\n");
+        return 1;
+    }
+#endif
+
+    if (gl3wInit() != 0)
+    {
+        fprintf(stderr, "Failed to initialize OpenGL loader!\n");
+        return 1;
+    }
+
+    if (headlessSpp > 0)
+        renderOptions.maxSpp = headlessSpp;
+
+    // Each process of a distributed render takes its own range of sample indices
+    if (headlessSampleOffset >= 0)
+    {
+        if (renderOptions.maxSpp % renderOptions.samplesPerPass != 0)
+        {
+            printf("The sample count of a range needs to be a multiple of samplesPerPass (%d)\n", renderOptions.samplesPerPass);
+            return 1;
+        }
+        renderOptions.sampleOffset = headlessSampleOffset;
+    }
+
+    if (renderOptions.maxSpp <= 0)
+    {
+        printf("Headless rendering needs --spp or a maxSpp in the scene\n");
+        return 1;
+    }
+
+    // Nothing is shown while loading, so the whole scene is read before rendering
+    FinishSceneLoad();
+
+    scene->renderOptions = renderOptions;
+    if (!InitRenderer())
+        return 1;
+
+    WriteSceneSnapshot();
+
+    if (!resumeFile.empty())
+        renderer->LoadCheckpoint(resumeFile);
+
+    // Nothing is presented, so frames are rendered back to back until the image is complete
+    auto startTime = std::chrono::steady_clock::now();
+    int lastSampleCount = 0;
+
+    while (!renderer->IsComplete())
+    {
+        renderer->Update(0.0f);
+        renderer->Render();
+        UpdateCheckpoint();
+
+        if (renderer->GetSampleCount() != lastSampleCount)
+        {
+            lastSampleCount = renderer->GetSampleCount();
+            printf("\rSamples: %d / %d", std::min(lastSampleCount, renderOptions.maxSpp), renderOptions.maxSpp);
+            fflush(stdout);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    printf("\nRender time: %.2fs\n", seconds);
+
+    renderer->SaveOutput(outputFile);
+    renderer->FlushOutputs();
+
+    delete renderer;
+    delete scene;
+
+#if defined(_WIN32) || defined(__APPLE__)
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+#else
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+#endif
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     srand((unsigned int)time(0));
@@ -548,6 +887,68 @@ int main(int argc, char** argv)
         {
             sceneFile = argv[++i];
         }
+        else if (arg == "--headless")
+        {
+            headless = true;
+        }
+        else if (arg == "--spp")
+        {
+            headlessSpp = atoi(argv[++i]);
+        }
+        else if (arg == "-o" || arg == "--out")
+        {
+            outputFile = argv[++i];
+        }
+        else if (arg == "--checkpoint")
+        {
+            checkpointFile = argv[++i];
+        }
+        else if (arg == "--checkpoint-interval")
+        {
+            checkpointInterval = (float)atof(argv[++i]);
+        }
+        else if (arg == "--resume")
+        {
+            resumeFile = argv[++i];
+        }
+        else if (arg == "--sample-range")
+        {
+            if (sscanf(argv[++i], "%d:%d", &headlessSampleOffset, &headlessSpp) != 2 || headlessSampleOffset < 0 || headlessSpp <= 0)
+            {
+                printf("Sample ranges are given as start:count\n");
+                exit(0);
+            }
+        }
+        else if (arg == "--shader-cache")
+        {
+            shaderCacheDir = argv[++i];
+            if (!shaderCacheDir.empty() && shaderCacheDir.back() != '/' && shaderCacheDir.back() != '\\')
+                shaderCacheDir += '/';
+        }
+        else if (arg == "--no-shader-cache")
+        {
+            shaderCacheDir.clear();
+        }
+        else if (arg == "--scene-cache")
+        {
+            sceneCacheDir = argv[++i];
+            if (!sceneCacheDir.empty() && sceneCacheDir.back() != '/' && sceneCacheDir.back() != '\\')
+                sceneCacheDir += '/';
+        }
+        else if (arg == "--no-scene-cache")
+        {
+            sceneCacheDir.clear();
+        }
+        else if (arg == "--scene-cache-hash-contents")
+        {
+            sceneCacheHashContents = true;
+        }
+        else if (arg == "--merge")
+        {
+            mergeOutput = argv[++i];
+            while (i + 1 < argc && argv[i + 1][0] != '-')
+                mergeInputs.push_back(argv[++i]);
+        }
         else if (arg[0] == '-')
         {
             printf("Unknown option %s \n'", arg.c_str());
@@ -555,6 +956,22 @@ int main(int argc, char** argv)
         }
     }
 
+    // Merging only reads files, so it needs neither a scene nor a GL context
+    if (!mergeOutput.empty())
+        return Renderer::MergeAccumulations(mergeInputs, mergeOutput) ? 0 : 1;
+
+    // Linked shader programs and processed scenes are cached in these directories, they are created on the first run
+    for (const std::string& cacheDir : { shaderCacheDir, sceneCacheDir })
+    {
+        if (cacheDir.empty())
+            continue;
+#ifdef _WIN32
+        _mkdir(cacheDir.c_str());
+#else
+        mkdir(cacheDir.c_str(), 0755);
+#endif
+    }
+
     if (!sceneFile.empty())
     {
         scene = new Scene();
@@ -568,6 +985,9 @@ int main(int argc, char** argv)
         LoadScene(sceneFiles[sampleSceneIdx]);
     }
 
+    if (headless)
+        return RenderHeadless();
+
     // Setup SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
     {
@@ -644,14 +1064,13 @@ int main(int argc, char** argv)
     ImGui_ImplOpenGL3_Init(glsl_version);
 
     ImGui::StyleColorsDark();
-    if (!InitRenderer())
-        return 1;
 
     while (!done)
     {
         MainLoop(&loopdata);
     }
 
+    delete sceneLoader;
     delete renderer;
     delete scene;
 
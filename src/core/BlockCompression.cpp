@@ -0,0 +1,251 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "BlockCompression.h"
+
+namespace GLSLPT
+{
+    // Simple range fit encoders. Endpoints are taken from the extent of the block along its principal axis
+    // and every texel picks the closest palette entry. Quality is close to the usual real-time encoders.
+    // In an optimized build a 4k colour map takes about a second of CPU time, spread over all cores
+
+    // Fewer rows of blocks than this aren't worth a thread
+    static const int kMinRowsPerThread = 16;
+
+    static unsigned short PackRGB565(const float* c)
+    {
+        int r = (int)std::round(std::min(std::max(c[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+        int g = (int)std::round(std::min(std::max(c[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+        int b = (int)std::round(std::min(std::max(c[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    static void UnpackRGB565(unsigned short v, int* c)
+    {
+        int r = (v >> 11) & 31;
+        int g = (v >> 5) & 63;
+        int b = v & 31;
+        c[0] = (r << 3) | (r >> 2);
+        c[1] = (g << 2) | (g >> 4);
+        c[2] = (b << 3) | (b >> 2);
+    }
+
+    // block: 16 RGBA texels, dst: 8 bytes
+    static void CompressBlockBC1(const unsigned char* block, unsigned char* dst)
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += block[i * 4 + c] / 16.0f;
+
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+        {
+            float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+            cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+        }
+
+        // Principal axis by power iteration
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iter = 0; iter < 8; iter++)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float len = std::max(std::max(std::abs(x), std::abs(y)), std::abs(z));
+            if (len < 1e-6f)
+                break;
+            axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+        }
+
+        float minT = 1e30f, maxT = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        float axisLenSq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if (axisLenSq > 0.0f)
+        {
+            minT /= axisLenSq;
+            maxT /= axisLenSq;
+        }
+
+        float e0[3], e1[3];
+        for (int c = 0; c < 3; c++)
+        {
+            e0[c] = mean[c] + axis[c] * maxT;
+            e1[c] = mean[c] + axis[c] * minT;
+        }
+
+        unsigned short c0 = PackRGB565(e0);
+        unsigned short c1 = PackRGB565(e1);
+
+        // c0 > c1 selects the four color mode
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        unsigned int indices = 0;
+        if (c0 != c1)
+        {
+            int palette[4][3];
+            UnpackRGB565(c0, palette[0]);
+            UnpackRGB565(c1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestDist = 1 << 30;
+                for (int p = 0; p < 4; p++)
+                {
+                    int dr = block[i * 4] - palette[p][0];
+                    int dg = block[i * 4 + 1] - palette[p][1];
+                    int db = block[i * 4 + 2] - palette[p][2];
+                    int dist = dr * dr + dg * dg + db * db;
+                    if (dist < bestDist)
+                    {
+                        bestDist = dist;
+                        best = p;
+                    }
+                }
+                indices |= best << (i * 2);
+            }
+        }
+
+        dst[0] = c0 & 0xFF;
+        dst[1] = c0 >> 8;
+        dst[2] = c1 & 0xFF;
+        dst[3] = c1 >> 8;
+        for (int i = 0; i < 4; i++)
+            dst[4 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+
+    // block: 16 texels of which every stride'th byte is encoded, dst: 8 bytes
+    static void CompressBlockBC4(const unsigned char* block, int stride, unsigned char* dst)
+    {
+        int minV = 255, maxV = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            minV = std::min(minV, (int)block[i * stride]);
+            maxV = std::max(maxV, (int)block[i * stride]);
+        }
+
+        // a0 > a1 selects the eight value mode where the values are spread evenly between the endpoints
+        unsigned long long indices = 0;
+        if (maxV > minV)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                int step = (int)std::round((block[i * stride] - minV) * 7.0f / (maxV - minV));
+                unsigned long long index = step == 7 ? 0 : step == 0 ? 1 : 8 - step;
+                indices |= index << (i * 3);
+            }
+        }
+
+        dst[0] = (unsigned char)maxV;
+        dst[1] = (unsigned char)minV;
+        for (int i = 0; i < 6; i++)
+            dst[2 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+
+    size_t TextureDataSize(TextureFormat format, int width, int height)
+    {
+        size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+        switch (format)
+        {
+        case FormatRGBA8: return (size_t)width * height * 4;
+        case FormatRG8:   return (size_t)width * height * 2;
+        case FormatBC1:   return blocks * 8;
+        case FormatBC3:
+        case FormatBC5:   return blocks * 16;
+        }
+        return 0;
+    }
+
+    void CompressTexture(const unsigned char* src, int width, int height, TextureFormat format, unsigned char* dst)
+    {
+        int channels = format == FormatBC5 ? 2 : 4;
+        int blockBytes = format == FormatBC1 ? 8 : 16;
+        int blocksX = width / 4;
+        int blocksY = height / 4;
+
+        // Rows of blocks are split between threads
+        auto compressRows = [=](int rowBegin, int rowEnd)
+        {
+            for (int by = rowBegin; by < rowEnd; by++)
+            {
+                unsigned char block[16 * 4];
+                for (int bx = 0; bx < blocksX; bx++)
+                {
+                    for (int y = 0; y < 4; y++)
+                    {
+                        const unsigned char* row = src + ((size_t)(by * 4 + y) * width + bx * 4) * channels;
+                        std::copy(row, row + 4 * channels, block + y * 4 * channels);
+                    }
+
+                    unsigned char* out = dst + ((size_t)by * blocksX + bx) * blockBytes;
+                    switch (format)
+                    {
+                    case FormatBC1:
+                        CompressBlockBC1(block, out);
+                        break;
+                    case FormatBC3:
+                        CompressBlockBC4(block + 3, 4, out);
+                        CompressBlockBC1(block, out + 8);
+                        break;
+                    case FormatBC5:
+                        CompressBlockBC4(block, 2, out);
+                        CompressBlockBC4(block + 1, 2, out + 8);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+            }
+        };
+
+        int numThreads = std::max(1, std::min((int)std::thread::hardware_concurrency(), blocksY / kMinRowsPerThread));
+        int rowsPerThread = (blocksY + numThreads - 1) / numThreads;
+
+        std::vector<std::thread> threads;
+        for (int i = 1; i < numThreads; i++)
+            threads.emplace_back(compressRows, i * rowsPerThread, std::min(blocksY, (i + 1) * rowsPerThread));
+        compressRows(0, std::min(blocksY, rowsPerThread));
+
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+
+namespace GLSLPT
+{
+    // Storage formats of the texture atlas pages
+    enum TextureFormat
+    {
+        FormatRGBA8,
+        FormatRG8,
+        FormatBC1, // RGB, 4 bpp
+        FormatBC3, // RGBA, 8 bpp
+        FormatBC5  // RG, 8 bpp
+    };
+
+    // Size in bytes of a width x height image in the given format
+    size_t TextureDataSize(TextureFormat format, int width, int height);
+
+    // Encodes an image into 4x4 blocks. width and height must be multiples of 4 and src has
+    // 4 channels per texel for BC1/BC3 and 2 channels for BC5
+    void CompressTexture(const unsigned char* src, int width, int height, TextureFormat format, unsigned char* dst);
+}
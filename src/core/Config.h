@@ -32,3 +32,22 @@
 #undef min
 #undef max
 #endif
+
+#include <cstring>
+
+namespace GLSLPT
+{
+    // Extensions are only listed one by one in a core context
+    inline bool IsExtensionSupported(const char* name)
+    {
+        GLint numExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+        for (GLint i = 0; i < numExtensions; i++)
+        {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,259 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "ImageWriter.h"
+#include "stb_image_write.h"
+
+namespace GLSLPT
+{
+    ImageWriter::ImageWriter() : busy(false), quit(false)
+    {
+        thread = std::thread(&ImageWriter::Run, this);
+    }
+
+    ImageWriter::~ImageWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        jobAdded.notify_one();
+        thread.join();
+    }
+
+    bool ImageWriter::IsFloatFormat(const std::string& filename)
+    {
+        std::string ext = filename.substr(filename.find_last_of(".") + 1);
+        return ext == "exr" || ext == "pfm" || ext == "hdr";
+    }
+
+    void ImageWriter::Write(const std::string& filename, int width, int height, std::vector<float>&& pixels)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(Job{ filename, width, height, std::move(pixels), std::vector<unsigned char>() });
+        jobAdded.notify_one();
+    }
+
+    void ImageWriter::Write(const std::string& filename, int width, int height, std::vector<unsigned char>&& pixels)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(Job{ filename, width, height, std::vector<float>(), std::move(pixels) });
+        jobAdded.notify_one();
+    }
+
+    void ImageWriter::Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [this]() { return jobs.empty() && !busy; });
+    }
+
+    void ImageWriter::Run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            jobAdded.wait(lock, [this]() { return quit || !jobs.empty(); });
+
+            // Queued images are still written when quitting
+            if (jobs.empty())
+                break;
+
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+            lock.unlock();
+
+            if (WriteImage(job))
+                printf("Frame saved: %s\n", job.filename.c_str());
+            else
+                printf("Unable to save frame: %s\n", job.filename.c_str());
+
+            lock.lock();
+            busy = false;
+            jobDone.notify_all();
+        }
+    }
+
+    bool ImageWriter::WriteImage(const Job& job)
+    {
+        std::string ext = job.filename.substr(job.filename.find_last_of(".") + 1);
+        const char* filename = job.filename.c_str();
+        int w = job.width;
+        int h = job.height;
+
+        if (!job.floatPixels.empty())
+        {
+            if (ext == "exr")
+                return WriteEXR(filename, w, h, job.floatPixels.data());
+            if (ext == "pfm")
+                return WritePFM(filename, w, h, job.floatPixels.data());
+
+            stbi_flip_vertically_on_write(true);
+            return stbi_write_hdr(filename, w, h, 4, job.floatPixels.data()) != 0;
+        }
+
+        // Only this thread writes through stb, so the flip flag can be set here
+        stbi_flip_vertically_on_write(true);
+        const unsigned char* data = job.bytePixels.data();
+
+        if (ext == "jpg" || ext == "jpeg")
+            return stbi_write_jpg(filename, w, h, 4, data, 95) != 0;
+        if (ext == "tga")
+            return stbi_write_tga(filename, w, h, 4, data) != 0;
+        if (ext == "bmp")
+            return stbi_write_bmp(filename, w, h, 4, data) != 0;
+
+        return stbi_write_png(filename, w, h, 4, data, w * 4) != 0;
+    }
+
+    // Single part scanline OpenEXR file with uncompressed 32 bit float RGBA channels
+    // https://openexr.com/en/latest/OpenEXRFileLayout.html
+    bool ImageWriter::WriteEXR(const std::string& filename, int width, int height, const float* pixels)
+    {
+        std::vector<unsigned char> header;
+
+        auto put = [&header](const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            header.insert(header.end(), bytes, bytes + size);
+        };
+
+        auto putInt = [&put](int value) { put(&value, 4); };
+        auto putFloat = [&put](float value) { put(&value, 4); };
+        auto putString = [&put](const char* str) { put(str, strlen(str) + 1); };
+
+        auto putAttribute = [&](const char* name, const char* type, int size)
+        {
+            putString(name);
+            putString(type);
+            putInt(size);
+        };
+
+        // Magic number and version 2 (single part scanline)
+        putInt(20000630);
+        putInt(2);
+
+        // Channels are stored in alphabetical order
+        const char* channels[] = { "A", "B", "G", "R" };
+        putAttribute("channels", "chlist", 4 * 18 + 1);
+        for (int i = 0; i < 4; i++)
+        {
+            putString(channels[i]);
+            putInt(2); // FLOAT
+            putInt(0); // pLinear and reserved
+            putInt(1); // xSampling
+            putInt(1); // ySampling
+        }
+        header.push_back(0);
+
+        putAttribute("compression", "compression", 1);
+        header.push_back(0); // NO_COMPRESSION
+
+        int window[] = { 0, 0, width - 1, height - 1 };
+        putAttribute("dataWindow", "box2i", 16);
+        put(window, 16);
+        putAttribute("displayWindow", "box2i", 16);
+        put(window, 16);
+
+        putAttribute("lineOrder", "lineOrder", 1);
+        header.push_back(0); // INCREASING_Y
+
+        putAttribute("pixelAspectRatio", "float", 4);
+        putFloat(1.0f);
+
+        putAttribute("screenWindowCenter", "v2f", 8);
+        putFloat(0.0f);
+        putFloat(0.0f);
+
+        putAttribute("screenWindowWidth", "float", 4);
+        putFloat(1.0f);
+
+        header.push_back(0);
+
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file)
+            return false;
+
+        // Offset table with the position of every scanline
+        int lineSize = width * 4 * sizeof(float);
+        unsigned long long offset = header.size() + sizeof(unsigned long long) * height;
+        std::vector<unsigned long long> offsets(height);
+        for (int y = 0; y < height; y++)
+            offsets[y] = offset + (unsigned long long)y * (8 + lineSize);
+
+        fwrite(header.data(), 1, header.size(), file);
+        fwrite(offsets.data(), sizeof(unsigned long long), height, file);
+
+        // EXR stores the top row first while the pixels start at the bottom
+        std::vector<float> line(width * 4);
+        for (int y = 0; y < height; y++)
+        {
+            const float* row = pixels + (size_t)(height - 1 - y) * width * 4;
+            for (int c = 0; c < 4; c++)
+            {
+                int src = c == 0 ? 3 : 2 - (c - 1); // A, B, G, R
+                for (int x = 0; x < width; x++)
+                    line[c * width + x] = row[x * 4 + src];
+            }
+
+            fwrite(&y, 4, 1, file);
+            fwrite(&lineSize, 4, 1, file);
+            fwrite(line.data(), 1, lineSize, file);
+        }
+
+        bool success = ferror(file) == 0;
+        fclose(file);
+        return success;
+    }
+
+    // Portable float map. Rows are stored bottom to top and a negative scale marks little endian data
+    bool ImageWriter::WritePFM(const std::string& filename, int width, int height, const float* pixels)
+    {
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file)
+            return false;
+
+        fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+
+        std::vector<float> line(width * 3);
+        for (int y = 0; y < height; y++)
+        {
+            const float* row = pixels + (size_t)y * width * 4;
+            for (int x = 0; x < width; x++)
+            {
+                line[x * 3 + 0] = row[x * 4 + 0];
+                line[x * 3 + 1] = row[x * 4 + 1];
+                line[x * 3 + 2] = row[x * 4 + 2];
+            }
+            fwrite(line.data(), sizeof(float), width * 3, file);
+        }
+
+        bool success = ferror(file) == 0;
+        fclose(file);
+        return success;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace GLSLPT
+{
+    // Encodes and writes images on a background thread. The format is picked from the file extension:
+    // exr, pfm and hdr take float data, png, jpg, tga and bmp take 8 bit data.
+    // Pixels are RGBA with rows ordered bottom to top, as read back from OpenGL
+    class ImageWriter
+    {
+    public:
+        ImageWriter();
+        ~ImageWriter();
+
+        static bool IsFloatFormat(const std::string& filename);
+
+        void Write(const std::string& filename, int width, int height, std::vector<float>&& pixels);
+        void Write(const std::string& filename, int width, int height, std::vector<unsigned char>&& pixels);
+
+        // Blocks until every queued image was written
+        void Wait();
+
+    private:
+        struct Job
+        {
+            std::string filename;
+            int width;
+            int height;
+            std::vector<float> floatPixels;
+            std::vector<unsigned char> bytePixels;
+        };
+
+        void Run();
+        static bool WriteImage(const Job& job);
+        static bool WriteEXR(const std::string& filename, int width, int height, const float* pixels);
+        static bool WritePFM(const std::string& filename, int width, int height, const float* pixels);
+
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable jobAdded;
+        std::condition_variable jobDone;
+        std::deque<Job> jobs;
+        bool busy;
+        bool quit;
+    };
+}
@@ -26,6 +26,7 @@
 
 #include <vector>
 #include "Vec3.h"
+#include "MathUtils.h"
 
 namespace GLSLPT
 {
@@ -118,4 +119,37 @@ namespace GLSLPT
         float alphaCutoff;
         float padding2;
     };
-}
\ No newline at end of file
+
+    // Compact GPU layout of a Material: 3 RGBA32UI texels instead of 8 RGBA32F.
+    // Colors, roughness, ior and medium values are half floats, 0..1 factors are unorm8 and
+    // texture IDs are 16 bit (0xFFFF for none). Decoded by GetMaterial in pathtrace.glsl
+    struct PackedMaterial
+    {
+        PackedMaterial(const Material& mat)
+        {
+            auto halves = [](float lo, float hi) { return (unsigned int)Math::FloatToHalf(lo) | ((unsigned int)Math::FloatToHalf(hi) << 16); };
+            auto unorms = [](float a, float b, float c, float d)
+            {
+                return Math::FloatToUnorm8(a) | (Math::FloatToUnorm8(b) << 8) | (Math::FloatToUnorm8(c) << 16) | (Math::FloatToUnorm8(d) << 24);
+            };
+            auto texIDs = [](float lo, float hi) { return (((unsigned int)(lo + 1.0f) - 1) & 0xFFFF) | ((((unsigned int)(hi + 1.0f) - 1) & 0xFFFF) << 16); };
+
+            data[0] = halves(mat.baseColor.x, mat.baseColor.y);
+            data[1] = halves(mat.baseColor.z, mat.roughness);
+            data[2] = halves(mat.emission.x, mat.emission.y);
+            data[3] = halves(mat.emission.z, mat.ior);
+
+            data[4] = unorms(mat.metallic, mat.subsurface, mat.specularTint, mat.anisotropic);
+            data[5] = unorms(mat.sheen, mat.sheenTint, mat.clearcoat, mat.clearcoatGloss);
+            data[6] = unorms(mat.specTrans, mat.opacity, mat.alphaCutoff, 0.0f) | ((unsigned int)mat.mediumType << 24) | ((unsigned int)mat.alphaMode << 28);
+            data[7] = halves(mat.mediumDensity, mat.mediumAnisotropy);
+
+            data[8] = texIDs(mat.baseColorTexId, mat.metallicRoughnessTexID);
+            data[9] = texIDs(mat.normalmapTexID, mat.emissionmapTexID);
+            data[10] = halves(mat.mediumColor.x, mat.mediumColor.y);
+            data[11] = halves(mat.mediumColor.z, 0.0f);
+        }
+
+        unsigned int data[12];
+    };
+}
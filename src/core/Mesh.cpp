@@ -25,8 +25,12 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <functional>
 #include "tiny_obj_loader.h"
 #include "Mesh.h"
+#include "MappedFile.h"
 
 namespace GLSLPT
 {
@@ -41,66 +45,364 @@ namespace GLSLPT
         return (p < 0.f) ? p + 2.f * PI : p;
     }
 
+    // OBJ files are split into chunks of whole lines that are parsed on separate threads.
+    // Chunks are at least this large so small files are parsed on the calling thread only
+    static const size_t kObjMinChunkSize = 4 << 20;
+
+    static const float kUnitTexCoords[3][2] = { { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f } };
+
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+
+        // Counted in the first pass, the bases are the totals of all preceding chunks
+        size_t numPositions, numTexCoords, numNormals, numTriangles;
+        size_t positionBase, texCoordBase, normalBase, triangleBase;
+    };
+
+    struct ObjIndex
+    {
+        int v, vt, vn;
+    };
+
+    enum ObjLineType
+    {
+        ObjOther,
+        ObjPosition,
+        ObjTexCoord,
+        ObjNormal,
+        ObjFace
+    };
+
+    static inline bool IsObjSpace(char c) { return c == ' ' || c == '\t'; }
+    static inline bool IsObjTokenEnd(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char* SkipObjSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsObjSpace(*p))
+            p++;
+        return p;
+    }
+
+    // Classifies the line starting at p and moves p past its keyword
+    static ObjLineType ObjLine(const char*& p, const char* end)
+    {
+        p = SkipObjSpaces(p, end);
+        if (end - p < 2 || p[0] == '#')
+            return ObjOther;
+
+        if (p[0] == 'v' && IsObjSpace(p[1]))
+        {
+            p += 2;
+            return ObjPosition;
+        }
+        if (p[0] == 'f' && IsObjSpace(p[1]))
+        {
+            p += 2;
+            return ObjFace;
+        }
+        if (end - p >= 3 && p[0] == 'v' && IsObjSpace(p[2]))
+        {
+            p += 3;
+            return p[-2] == 't' ? ObjTexCoord : p[-2] == 'n' ? ObjNormal : ObjOther;
+        }
+        return ObjOther;
+    }
+
+    // Numbers are converted like tinyobjloader does, so meshes come out the same as they used to
+    static const char* ParseObjFloat(const char* p, const char* end, float& value)
+    {
+        p = SkipObjSpaces(p, end);
+        const char* tokenEnd = p;
+        while (tokenEnd < end && !IsObjTokenEnd(*tokenEnd))
+            tokenEnd++;
+
+        double val = 0.0;
+        tinyobj::tryParseDouble(p, tokenEnd, &val);
+        value = (float)val;
+        return tokenEnd;
+    }
+
+    static const char* ParseObjInt(const char* p, const char* end, int& value)
+    {
+        bool negative = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+            p++;
+
+        value = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            value = value * 10 + (*p++ - '0');
+        if (negative)
+            value = -value;
+
+        // Skip anything up to the next part of the index
+        while (p < end && *p != '/' && !IsObjTokenEnd(*p))
+            p++;
+        return p;
+    }
+
+    // v, v/vt, v//vn or v/vt/vn. Indices are 1-based or relative to the elements read so far, missing ones are -1
+    static const char* ParseObjIndex(const char* p, const char* end, int numPositions, int numTexCoords, int numNormals, ObjIndex& index)
+    {
+        int value;
+        index.vt = index.vn = -1;
+
+        p = ParseObjInt(p, end, value);
+        index.v = tinyobj::fixIndex(value, numPositions);
+        if (p == end || *p != '/')
+            return p;
+        p++;
+
+        if (p < end && *p == '/')
+        {
+            p = ParseObjInt(p + 1, end, value);
+            index.vn = tinyobj::fixIndex(value, numNormals);
+            return p;
+        }
+
+        p = ParseObjInt(p, end, value);
+        index.vt = tinyobj::fixIndex(value, numTexCoords);
+        if (p == end || *p != '/')
+            return p;
+
+        p = ParseObjInt(p + 1, end, value);
+        index.vn = tinyobj::fixIndex(value, numNormals);
+        return p;
+    }
+
+    template <typename Func>
+    static void ForEachObjChunk(std::vector<ObjChunk>& chunks, Func func)
+    {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < chunks.size(); i++)
+            threads.emplace_back(func, std::ref(chunks[i]));
+        func(chunks[0]);
+
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
     bool Mesh::LoadFromFile(const std::string& filename)
     {
         name = filename;
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string err;
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str(), 0, true);
 
-        if (!ret)
+        // The file is parsed in three passes over the mapping: counting lines to find where each chunk writes to,
+        // reading the positions, texture coordinates and normals, and reading the faces straight into the mesh arrays
+        MappedFile file;
+        if (!file.Open(filename))
         {
             printf("Unable to load model\n");
             return false;
         }
 
-        // Loop over shapes
-        for (size_t s = 0; s < shapes.size(); s++)
+        const char* data = file.Data();
+        size_t size = file.Size();
+
+        int numThreads = std::max(1u, std::thread::hardware_concurrency());
+        size_t numChunks = std::max((size_t)1, std::min((size_t)numThreads, size / kObjMinChunkSize));
+
+        std::vector<ObjChunk> chunks(numChunks);
+        const char* chunkBegin = data;
+        for (size_t i = 0; i < numChunks; i++)
         {
-            // Loop over faces(polygon)
-            size_t index_offset = 0;
+            const char* chunkEnd = data + size;
+            if (i + 1 < numChunks)
+            {
+                chunkEnd = std::max(chunkBegin, data + size / numChunks * (i + 1));
+                const char* newline = (const char*)memchr(chunkEnd, '\n', data + size - chunkEnd);
+                chunkEnd = newline ? newline + 1 : data + size;
+            }
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
 
-            for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+        ForEachObjChunk(chunks, [](ObjChunk& chunk)
+        {
+            chunk.numPositions = chunk.numTexCoords = chunk.numNormals = chunk.numTriangles = 0;
+            for (const char* line = chunk.begin; line < chunk.end;)
             {
-                // Loop over vertices in the face.
-                for (size_t v = 0; v < 3; v++)
+                const char* lineEnd = (const char*)memchr(line, '\n', chunk.end - line);
+                lineEnd = lineEnd ? lineEnd : chunk.end;
+
+                const char* p = line;
+                switch (ObjLine(p, lineEnd))
+                {
+                case ObjPosition: chunk.numPositions++; break;
+                case ObjTexCoord: chunk.numTexCoords++; break;
+                case ObjNormal: chunk.numNormals++; break;
+                case ObjFace:
                 {
-                    // access to vertex
-                    tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                    tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-                    tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-                    tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-                    tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-                    tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-                    tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-
-                    tinyobj::real_t tx, ty;
-
-                    if (!attrib.texcoords.empty())
+                    // Polygons are split into triangle fans
+                    int numCorners = 0;
+                    while ((p = SkipObjSpaces(p, lineEnd)) < lineEnd && *p != '\r')
                     {
-                        tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-                        ty = 1.0 - attrib.texcoords[2 * idx.texcoord_index + 1];
+                        while (p < lineEnd && !IsObjTokenEnd(*p))
+                            p++;
+                        numCorners++;
                     }
-                    else
+                    chunk.numTriangles += std::max(0, numCorners - 2);
+                    break;
+                }
+                default:
+                    break;
+                }
+                line = lineEnd + 1;
+            }
+        });
+
+        size_t numPositions = 0, numTexCoords = 0, numNormals = 0, numTriangles = 0;
+        for (ObjChunk& chunk : chunks)
+        {
+            chunk.positionBase = numPositions;
+            chunk.texCoordBase = numTexCoords;
+            chunk.normalBase = numNormals;
+            chunk.triangleBase = numTriangles;
+            numPositions += chunk.numPositions;
+            numTexCoords += chunk.numTexCoords;
+            numNormals += chunk.numNormals;
+            numTriangles += chunk.numTriangles;
+        }
+
+        std::vector<float> positions(numPositions * 3);
+        std::vector<float> texCoords(numTexCoords * 2);
+        std::vector<float> normals(numNormals * 3);
+
+        ForEachObjChunk(chunks, [&](ObjChunk& chunk)
+        {
+            float* position = positions.data() + chunk.positionBase * 3;
+            float* texCoord = texCoords.data() + chunk.texCoordBase * 2;
+            float* normal = normals.data() + chunk.normalBase * 3;
+
+            for (const char* line = chunk.begin; line < chunk.end;)
+            {
+                const char* lineEnd = (const char*)memchr(line, '\n', chunk.end - line);
+                lineEnd = lineEnd ? lineEnd : chunk.end;
+
+                const char* p = line;
+                switch (ObjLine(p, lineEnd))
+                {
+                case ObjPosition:
+                    p = ParseObjFloat(p, lineEnd, position[0]);
+                    p = ParseObjFloat(p, lineEnd, position[1]);
+                    ParseObjFloat(p, lineEnd, position[2]);
+                    position += 3;
+                    break;
+                case ObjTexCoord:
+                    p = ParseObjFloat(p, lineEnd, texCoord[0]);
+                    ParseObjFloat(p, lineEnd, texCoord[1]);
+                    texCoord += 2;
+                    break;
+                case ObjNormal:
+                    p = ParseObjFloat(p, lineEnd, normal[0]);
+                    p = ParseObjFloat(p, lineEnd, normal[1]);
+                    ParseObjFloat(p, lineEnd, normal[2]);
+                    normal += 3;
+                    break;
+                default:
+                    break;
+                }
+                line = lineEnd + 1;
+            }
+        });
+
+        verticesUVX.resize(numTriangles * 3);
+        normalsUVY.resize(numTriangles * 3);
+        std::vector<int> vertexPositions(numTriangles * 3);
+        std::atomic<bool> invalidIndex(false);
+        std::atomic<bool> missingNormals(false);
+
+        ForEachObjChunk(chunks, [&](ObjChunk& chunk)
+        {
+            // Relative indices refer to the elements read before the face
+            int numV = chunk.positionBase;
+            int numVT = chunk.texCoordBase;
+            int numVN = chunk.normalBase;
+            size_t vertex = chunk.triangleBase * 3;
+            std::vector<ObjIndex> face;
+
+            for (const char* line = chunk.begin; line < chunk.end;)
+            {
+                const char* lineEnd = (const char*)memchr(line, '\n', chunk.end - line);
+                lineEnd = lineEnd ? lineEnd : chunk.end;
+
+                const char* p = line;
+                ObjLineType type = ObjLine(p, lineEnd);
+                line = lineEnd + 1;
+
+                numV += type == ObjPosition;
+                numVT += type == ObjTexCoord;
+                numVN += type == ObjNormal;
+                if (type != ObjFace)
+                    continue;
+
+                face.clear();
+                while ((p = SkipObjSpaces(p, lineEnd)) < lineEnd && *p != '\r')
+                {
+                    ObjIndex index;
+                    p = ParseObjIndex(p, lineEnd, numV, numVT, numVN, index);
+                    while (p < lineEnd && !IsObjTokenEnd(*p))
+                        p++;
+                    face.push_back(index);
+                }
+
+                for (size_t k = 2; k < face.size(); k++)
+                {
+                    const ObjIndex corners[3] = { face[0], face[k - 1], face[k] };
+
+                    for (int c = 0; c < 3; c++)
                     {
-                        if (v == 0)
-                            tx = ty = 0;
-                        else if (v == 1)
-                            tx = 0, ty = 1;
+                        const ObjIndex& index = corners[c];
+                        if (index.v < 0 || index.v >= (int)numPositions)
+                        {
+                            invalidIndex = true;
+                            return;
+                        }
+
+                        const float* position = &positions[index.v * 3];
+                        vertexPositions[vertex + c] = index.v;
+
+                        // Corners without texture coordinates get the ones of a unit triangle
+                        float tx, ty;
+                        if (index.vt >= 0 && index.vt < (int)numTexCoords)
+                        {
+                            tx = texCoords[index.vt * 2 + 0];
+                            ty = (float)(1.0 - texCoords[index.vt * 2 + 1]);
+                        }
                         else
-                            tx = ty = 1;
+                        {
+                            tx = kUnitTexCoords[c][0];
+                            ty = kUnitTexCoords[c][1];
+                        }
+
+                        // Missing normals are left zero and smoothed once all faces are read
+                        Vec3 n;
+                        if (index.vn >= 0 && index.vn < (int)numNormals)
+                            n = Vec3(normals[index.vn * 3 + 0], normals[index.vn * 3 + 1], normals[index.vn * 3 + 2]);
+                        else
+                            missingNormals = true;
+
+                        verticesUVX[vertex + c] = Vec4(position[0], position[1], position[2], tx);
+                        normalsUVY[vertex + c] = Vec4(n.x, n.y, n.z, ty);
                     }
 
-                    verticesUVX.push_back(Vec4(vx, vy, vz, tx));
-                    normalsUVY.push_back(Vec4(nx, ny, nz, ty));
+                    vertex += 3;
                 }
-
-                index_offset += 3;
             }
+        });
+
+        if (invalidIndex || numTriangles == 0)
+        {
+            verticesUVX.clear();
+            normalsUVY.clear();
+            printf("Unable to load model\n");
+            return false;
         }
 
+        if (missingNormals)
+            SmoothNormals(vertexPositions, numPositions);
+
         /*Vec3 center = Vec3(0.0, 0.0, 0.0);
 
         for (int i = 0; i < verticesUVX.size(); i++)
@@ -118,6 +420,43 @@ namespace GLSLPT
         return true;
     }
 
+    void Mesh::SmoothNormals(const std::vector<int>& vertexPositions, size_t numPositions)
+    {
+        // Vertices without a normal get the sum of the normals of the triangles sharing their position.
+        // The cross product is twice the triangle area, so larger triangles weigh more
+        std::vector<Vec3> positionNormals(numPositions);
+        std::vector<Vec3> faceNormals(verticesUVX.size() / 3);
+        for (size_t i = 0; i < faceNormals.size(); i++)
+        {
+            Vec3 v0 = Vec3(verticesUVX[i * 3 + 0]);
+            faceNormals[i] = Vec3::Cross(Vec3(verticesUVX[i * 3 + 1]) - v0, Vec3(verticesUVX[i * 3 + 2]) - v0);
+            for (int c = 0; c < 3; c++)
+            {
+                Vec3& n = positionNormals[vertexPositions[i * 3 + c]];
+                n = n + faceNormals[i];
+            }
+        }
+
+        for (size_t i = 0; i < normalsUVY.size(); i++)
+        {
+            Vec4& normal = normalsUVY[i];
+            if (normal.x != 0.0f || normal.y != 0.0f || normal.z != 0.0f)
+                continue;
+
+            // Falls back to the triangle's own normal where the normals around a position cancel out
+            Vec3 n = positionNormals[vertexPositions[i]];
+            float length = Vec3::Length(n);
+            if (length == 0.0f)
+            {
+                n = faceNormals[i / 3];
+                length = Vec3::Length(n);
+            }
+
+            n = length > 0.0f ? n * (1.0f / length) : Vec3(0.0f, 1.0f, 0.0f);
+            normal = Vec4(n.x, n.y, n.z, normal.w);
+        }
+    }
+
     void Mesh::BuildBVH()
     {
         const int numTris = verticesUVX.size() / 3;
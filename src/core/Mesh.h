@@ -47,6 +47,9 @@ namespace GLSLPT
 
         RadeonRays::Bvh* bvh;
         std::string name;
+
+    private:
+        void SmoothNormals(const std::vector<int>& vertexPositions, size_t numPositions);
     };
 
     class MeshInstance
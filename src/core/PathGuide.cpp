@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <math.h>
+#include <algorithm>
+#include "PathGuide.h"
+
+namespace GLSLPT
+{
+    // Cells that saw fewer records than this aren't guided
+    static const int kMinCellRecords = 32;
+
+    // Fraction of a cell's weight spread uniformly over its bins, so directions that were never sampled can still be guided towards
+    static const float kUniformPrior = 0.05f;
+
+    PathGuide::PathGuide(const Vec3& boundsMin, const Vec3& boundsMax, int maxGridRes, int dirRes) : dirRes(dirRes)
+    {
+        // Cells are roughly cubic, with maxGridRes cells along the longest axis of the bounds
+        Vec3 extents = boundsMax - boundsMin;
+        float cellSize = std::max(extents.x, std::max(extents.y, extents.z)) / maxGridRes;
+        cellSize = std::max(cellSize, 1e-4f);
+
+        for (int i = 0; i < 3; i++)
+        {
+            gridRes[i] = std::max(1, std::min(maxGridRes, (int)ceilf(extents[i] / cellSize)));
+            invCellSize[i] = gridRes[i] / std::max(extents[i], 1e-4f);
+        }
+        gridMin = boundsMin;
+
+        Reset();
+    }
+
+    void PathGuide::Reset()
+    {
+        binWeights.assign(NumCells() * NumBins(), 0.0f);
+        cellRecords.assign(NumCells(), 0);
+    }
+
+    void PathGuide::AddRecord(const Vec3& position, const Vec3& direction, float weight)
+    {
+        int cell = 0;
+        for (int i = 2; i >= 0; i--)
+        {
+            int c = (int)((position[i] - gridMin[i]) * invCellSize[i]);
+            cell = cell * gridRes[i] + std::max(0, std::min(gridRes[i] - 1, c));
+        }
+
+        // Same mapping as GuideBin() in guiding.glsl
+        float phi = atan2f(direction.y, direction.x);
+        if (phi < 0.0f)
+            phi += 2.0f * PI;
+        int x = std::min((int)(phi / (2.0f * PI) * dirRes), dirRes - 1);
+        int y = std::max(0, std::min((int)((direction.z + 1.0f) * 0.5f * dirRes), dirRes - 1));
+
+        binWeights[cell * NumBins() + y * dirRes + x] += weight;
+        cellRecords[cell]++;
+    }
+
+    void PathGuide::BuildCDF(std::vector<float>& cdf) const
+    {
+        int numBins = NumBins();
+        int rowSize = RowSize();
+        cdf.assign(NumCells() * rowSize, 0.0f);
+
+        for (int cell = 0; cell < NumCells(); cell++)
+        {
+            const float* weights = &binWeights[cell * numBins];
+            float* row = &cdf[cell * rowSize];
+
+            float total = 0.0f;
+            for (int i = 0; i < numBins; i++)
+                total += weights[i];
+
+            if (cellRecords[cell] < kMinCellRecords || !(total > 0.0f))
+                continue;
+
+            float prior = kUniformPrior * total / numBins;
+            float sum = 0.0f;
+            for (int i = 0; i < numBins; i++)
+            {
+                sum += weights[i] + prior;
+                row[i] = sum;
+            }
+
+            for (int i = 0; i < numBins; i++)
+                row[i] /= sum;
+            row[numBins - 1] = 1.0f;
+            row[numBins] = (float)cellRecords[cell];
+
+            // Each record estimates the incident radiance integrated over the sphere
+            row[numBins + 1] = total / cellRecords[cell];
+        }
+    }
+}
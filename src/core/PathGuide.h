@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include "Vec3.h"
+
+namespace GLSLPT
+{
+    // Learns the directions radiance arrives from, so path vertices can sample them (Practical Path Guiding, Mueller et al. 2017).
+    // Instead of an SD-tree the scene bounds are split into a uniform grid, and each cell keeps an equal-area histogram of directions
+    // (uniform in cos(theta) and phi), which maps directly onto a texture row the shader can search
+    class PathGuide
+    {
+    public:
+        PathGuide(const Vec3& boundsMin, const Vec3& boundsMax, int maxGridRes, int dirRes);
+
+        void Reset();
+
+        // A path vertex that saw radiance arriving from direction, weighted by the inverse pdf of sampling it
+        void AddRecord(const Vec3& position, const Vec3& direction, float weight);
+
+        // One row per cell: the CDF over its directional bins, followed by the number of records it has learned from
+        // and the incident radiance integrated over the sphere
+        void BuildCDF(std::vector<float>& cdf) const;
+
+        int NumCells() const { return gridRes[0] * gridRes[1] * gridRes[2]; }
+        int NumBins() const { return dirRes * dirRes; }
+        int RowSize() const { return NumBins() + 2; }
+
+        Vec3 gridMin;
+        Vec3 invCellSize;
+        int gridRes[3];
+        int dirRes;
+
+    private:
+        std::vector<float> binWeights;
+        std::vector<int> cellRecords;
+    };
+}
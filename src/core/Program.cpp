@@ -33,6 +33,9 @@ namespace GLSLPT
         for (unsigned i = 0; i < shaders.size(); i++)
             glAttachShader(object, shaders[i].getObject());
 
+        if (BinarySupported())
+            glProgramParameteri(object, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
         glLinkProgram(object);
         for (unsigned i = 0; i < shaders.size(); i++)
             glDetachShader(object, shaders[i].getObject());
@@ -73,4 +76,60 @@ namespace GLSLPT
     {
         return object;
     }
+
+    GLint Program::GetUniformLocation(const std::string& name)
+    {
+        auto it = uniformLocations.find(name);
+        if (it == uniformLocations.end())
+            it = uniformLocations.insert(std::make_pair(name, glGetUniformLocation(object, name.c_str()))).first;
+        return it->second;
+    }
+
+    bool Program::BinarySupported()
+    {
+        // Checked once, gl3w leaves the entry points null on a driver without them
+        static int supported = -1;
+        if (supported < 0)
+        {
+            GLint numFormats = 0;
+            if ((gl3wIsSupported(4, 1) || IsExtensionSupported("GL_ARB_get_program_binary")) &&
+                glProgramParameteri && glProgramBinary && glGetProgramBinary)
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+            supported = numFormats > 0 ? 1 : 0;
+            if (!supported)
+                printf("Program binaries are not supported, the shader cache is disabled\n");
+        }
+        return supported == 1;
+    }
+
+    Program* Program::FromBinary(GLenum format, const std::vector<char>& binary)
+    {
+        Program* program = new Program();
+        program->object = glCreateProgram();
+        glProgramBinary(program->object, format, binary.data(), (GLsizei)binary.size());
+
+        GLint success = 0;
+        glGetProgramiv(program->object, GL_LINK_STATUS, &success);
+        if (success == GL_FALSE)
+        {
+            delete program;
+            return nullptr;
+        }
+
+        return program;
+    }
+
+    bool Program::GetBinary(GLenum& format, std::vector<char>& binary)
+    {
+        GLint size = 0;
+        glGetProgramiv(object, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0)
+            return false;
+
+        binary.resize(size);
+        GLsizei length = 0;
+        glGetProgramBinary(object, size, &length, &format, binary.data());
+        binary.resize(length);
+        return length > 0;
+    }
 }
\ No newline at end of file
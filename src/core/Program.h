@@ -25,6 +25,7 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 #include "Shader.h"
 
 namespace GLSLPT
@@ -33,6 +34,8 @@ namespace GLSLPT
     {
     private:
         GLuint object;
+        std::unordered_map<std::string, GLint> uniformLocations;
+        Program() : object(0) {}
 
     public:
         Program(const std::vector<Shader> shaders);
@@ -40,5 +43,14 @@ namespace GLSLPT
         void Use();
         void StopUsing();
         GLuint getObject();
+
+        // Looked up once per name, for uniforms that are set every frame
+        GLint GetUniformLocation(const std::string& name);
+
+        // Linked program binaries, for caching. A binary only loads on the driver that created it, nullptr otherwise
+        // Only when BinarySupported(), which needs GL 4.1 or ARB_get_program_binary
+        static bool BinarySupported();
+        static Program* FromBinary(GLenum format, const std::vector<char>& binary);
+        bool GetBinary(GLenum& format, std::vector<char>& binary);
     };
 }
@@ -22,23 +22,323 @@
  * SOFTWARE.
  */
 
+#include <cmath>
+#include <random>
 #include "Config.h"
 #include "Renderer.h"
 #include "ShaderIncludes.h"
 #include "Scene.h"
-#include "OpenImageDenoise/oidn.hpp"
+
+// S3TC is an extension and not part of the core profile header
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
 namespace GLSLPT
 {
-    Program* LoadShaders(const ShaderInclude::ShaderSource& vertShaderObj, const ShaderInclude::ShaderSource& fragShaderObj)
+    // Uploads the materials to the currently bound texture, either packed or in the full layout (for debugging)
+    static void UploadMaterials(const std::vector<Material>& materials, bool packed)
+    {
+        if (packed)
+        {
+            std::vector<PackedMaterial> packedMaterials(materials.begin(), materials.end());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, (sizeof(PackedMaterial) / (sizeof(unsigned int) * 4)) * packedMaterials.size(), 1, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, &packedMaterials[0]);
+        }
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (sizeof(Material) / sizeof(Vec4)) * materials.size(), 1, 0, GL_RGBA, GL_FLOAT, &materials[0]);
+    }
+
+    // Adaptive sampling only starts testing pixels for convergence after this many samples
+    static const int kAdaptiveMinSpp = 16;
+
+    // Efficiency-aware Russian roulette only trusts the pixel estimate after this many samples
+    static const int kPixelEstimateMinSpp = 8;
+
+    // Preview resolution limits relative to the window. The maximum also sets the size of the preview textures
+    static const float kMinPreviewRatio = 0.0625f;
+    static const float kMaxPreviewRatio = 0.5f;
+
+    // Resolutions the preview is refined through once the camera stops, before tiled rendering takes over
+    static const float kPreviewRefineRatios[] = { 0.25f, 0.5f };
+    static const int kNumPreviewRefineLevels = sizeof(kPreviewRefineRatios) / sizeof(float);
+
+    // Size of the tileable blue noise texture, which has to match the wrapping in sampler.glsl
+    static const int kBlueNoiseSize = 64;
+
+    // Path guiding: cells along the longest axis of the scene, directional bins per axis (OPT_GUIDING_RES),
+    // size of the training passes and the number of them, and surface vertices recorded per training path (OPT_GUIDING_TRAIN)
+    static const int kGuideGridRes = 16;
+    static const int kGuideDirRes = 16;
+    static const int kGuideTrainSize = 128;
+    static const int kGuideTrainPasses = 32;
+    static const int kGuideTrainVertices = 3;
+
+    // Training paths use sample indices far beyond the ones of the image
+    static const int kGuideTrainSampleIndex = 1 << 30;
+
+    // Checkpoints start with this header, followed by the accumulation textures
+    static const char kCheckpointMagic[8] = { 'G', 'L', 'P', 'T', 'C', 'K', 'P', 'T' };
+    static const int kCheckpointVersion = 2;
+
+    struct CheckpointHeader
+    {
+        char magic[8];
+        int version;
+        int flags; // 1: sample moments, 2: denoiser AOVs
+        unsigned long long sceneHash;
+        int width;
+        int height;
+        int sampleCounter;
+        int frameCounter;
+        int tileX;
+        int tileY;
+    };
+
+    // Accumulations of a sample range, which are merged with the ones of other ranges into the final image
+    static const char kAccumulationMagic[8] = { 'G', 'L', 'P', 'T', 'A', 'C', 'C', 'M' };
+    static const int kAccumulationVersion = 1;
+
+    struct AccumulationHeader
+    {
+        char magic[8];
+        int version;
+        int flags; // 1: per pixel sample counts
+        unsigned long long sceneHash;
+        int width;
+        int height;
+        int sampleOffset;
+        int numSamples;
+    };
+
+    static bool WriteAccumulation(const std::string& filename, const AccumulationHeader& header, const float* color, const float* counts)
+    {
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            printf("Unable to write accumulation %s\n", filename.c_str());
+            return false;
+        }
+
+        int numPixels = header.width * header.height;
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(color, sizeof(float), numPixels * 4, file);
+        if (header.flags & 1)
+            fwrite(counts, sizeof(float), numPixels, file);
+
+        bool success = ferror(file) == 0;
+        fclose(file);
+
+        if (!success)
+            printf("Unable to write accumulation %s\n", filename.c_str());
+
+        return success;
+    }
+
+    // Binding point of the FrameUniforms block. The struct matches its std140 layout in uniforms.glsl
+    static const GLuint kFrameUniformsBinding = 0;
+
+    struct FrameUniforms
+    {
+        Vec3 cameraUp;
+        float pad0;
+        Vec3 cameraRight;
+        float pad1;
+        Vec3 cameraForward;
+        float pad2;
+        Vec3 cameraPosition;
+        float cameraFov;
+        float cameraFocalDist;
+        float cameraAperture;
+        float pad3[2];
+        Vec3 uniformLightCol;
+        float envMapIntensity;
+        float envMapRot;
+        float roughnessMollificationAmt;
+        int samplesPerPass;
+        int usePixelEstimate;
+    };
+    static_assert(sizeof(FrameUniforms) == 112, "FrameUniforms has to match the std140 layout of the block");
+
+    // Cached program binaries start with this header
+    static const char kProgramCacheMagic[8] = { 'G', 'L', 'P', 'T', 'P', 'R', 'O', 'G' };
+
+    struct ProgramCacheHeader
+    {
+        char magic[8];
+        unsigned int format;
+        int size;
+    };
+
+    static Program* ReadProgramCache(const std::string& filename)
+    {
+        FILE* file = fopen(filename.c_str(), "rb");
+        if (!file)
+            return nullptr;
+
+        ProgramCacheHeader header;
+        std::vector<char> binary;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, kProgramCacheMagic, sizeof(header.magic)) == 0 && header.size > 0;
+        if (valid)
+        {
+            binary.resize(header.size);
+            valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        fclose(file);
+
+        // A driver update can reject the binary, the program is then compiled again and the entry replaced
+        return valid ? Program::FromBinary(header.format, binary) : nullptr;
+    }
+
+    static void WriteProgramCache(const std::string& filename, Program* program)
+    {
+        ProgramCacheHeader header;
+        std::vector<char> binary;
+        GLenum format;
+        if (!program->GetBinary(format, binary))
+            return;
+
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            printf("Unable to write shader cache %s\n", filename.c_str());
+            return;
+        }
+
+        memcpy(header.magic, kProgramCacheMagic, sizeof(kProgramCacheMagic));
+        header.format = format;
+        header.size = (int)binary.size();
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(binary.data(), 1, binary.size(), file);
+        fclose(file);
+    }
+
+    Program* LoadShaders(const ShaderInclude::ShaderSource& vertShaderObj, const ShaderInclude::ShaderSource& fragShaderObj, const std::string& cacheDirectory)
     {
+        // Programs are cached by their sources, which hold the defines, and the driver that compiled them
+        std::string cacheFile;
+        if (!cacheDirectory.empty() && Program::BinarySupported())
+        {
+            unsigned long long hash = Math::HashSeed;
+            GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+            for (GLenum name : driverStrings)
+            {
+                const char* str = (const char*)glGetString(name);
+                if (str)
+                    hash = Math::HashBytes(hash, str, strlen(str));
+            }
+            hash = Math::HashBytes(hash, vertShaderObj.src.data(), vertShaderObj.src.size());
+            hash = Math::HashBytes(hash, fragShaderObj.src.data(), fragShaderObj.src.size());
+
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.bin", hash);
+            cacheFile = cacheDirectory + name;
+
+            Program* program = ReadProgramCache(cacheFile);
+            if (program)
+            {
+                printf("Loaded cached program %s\n", fragShaderObj.path.c_str());
+                return program;
+            }
+        }
+
         std::vector<Shader> shaders;
         shaders.push_back(Shader(vertShaderObj, GL_VERTEX_SHADER));
         shaders.push_back(Shader(fragShaderObj, GL_FRAGMENT_SHADER));
-        return new Program(shaders);
+        Program* program = new Program(shaders);
+
+        if (!cacheFile.empty())
+            WriteProgramCache(cacheFile, program);
+
+        return program;
+    }
+
+    // Ranks the texels of a tileable size x size texture by repeatedly filling its largest void (void and cluster, Ulichney 1993).
+    // Close texels get very different ranks, so any threshold of the normalized ranks gives a blue noise point set
+    static void GenerateBlueNoise(int size, unsigned int seed, float* ranks, int stride)
+    {
+        int numTexels = size * size;
+        const float sigma = 1.5f;
+
+        // Gaussian energy of a texel, by its wrapped offset from the texel that adds it
+        std::vector<float> kernel(numTexels);
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                int dx = std::min(x, size - x);
+                int dy = std::min(y, size - y);
+                kernel[y * size + x] = expf(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+
+        // A tiny random energy breaks ties, so each seed gives an independent pattern
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> jitter(0.0f, 1e-4f);
+        std::vector<float> energy(numTexels);
+        for (int i = 0; i < numTexels; i++)
+            energy[i] = jitter(rng);
+
+        std::vector<bool> filled(numTexels, false);
+        for (int rank = 0; rank < numTexels; rank++)
+        {
+            int best = -1;
+            for (int i = 0; i < numTexels; i++)
+            {
+                if (!filled[i] && (best < 0 || energy[i] < energy[best]))
+                    best = i;
+            }
+
+            filled[best] = true;
+            ranks[best * stride] = (rank + 0.5f) / numTexels;
+
+            int bx = best % size;
+            int by = best / size;
+            for (int y = 0; y < size; y++)
+            {
+                const float* row = &kernel[((y - by + size) % size) * size];
+                for (int x = 0; x < size; x++)
+                    energy[y * size + x] += row[(x - bx + size) % size];
+            }
+        }
+    }
+
+    static GLuint CreateTextureAtlas(const TextureAtlas& atlas, const BufferView& data, int width, int height)
+    {
+        GLuint tex;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        switch (atlas.format)
+        {
+        case FormatRGBA8:
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, atlas.numPages, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data);
+            break;
+        case FormatRG8:
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG8, width, height, atlas.numPages, 0, GL_RG, GL_UNSIGNED_BYTE, data.data);
+            break;
+        case FormatBC1:
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height, atlas.numPages, 0, data.size, data.data);
+            break;
+        case FormatBC3:
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, width, height, atlas.numPages, 0, data.size, data.data);
+            break;
+        case FormatBC5:
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_COMPRESSED_RG_RGTC2, width, height, atlas.numPages, 0, data.size, data.data);
+            break;
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return tex;
     }
 
-    Renderer::Renderer(Scene* scene, const std::string& shadersDirectory)
+    Renderer::Renderer(Scene* scene, const std::string& shadersDirectory, const std::string& shaderCacheDirectory)
         : scene(scene)
         , BVHBuffer(0)
         , BVHTex(0)
@@ -52,22 +352,55 @@ namespace GLSLPT
         , transformsTex(0)
         , lightsTex(0)
         , textureMapsArrayTex(0)
+        , textureMapsRGArrayTex(0)
+        , textureRectsTex(0)
         , envMapTex(0)
         , envMapCDFTex(0)
-        , pathTraceTextureLowRes(0)
-        , pathTraceTexture(0)
-        , accumTexture(0)
-        , tileOutputTexture()
-        , denoisedTexture(0)
-        , pathTraceFBO(0)
+        , blueNoiseTex(0)
+        , guideTex(0)
+        , frameUBO(0)
         , pathTraceFBOLowRes(0)
         , accumFBO(0)
         , outputFBO(0)
+        , pixelConvergenceFBO(0)
+        , convergenceFBO(0)
+        , previewHistoryFBO(0)
+        , denoisedFBO(0)
+        , guideTrainFBO(0)
         , shadersDirectory(shadersDirectory)
+        , shaderCacheDirectory(shaderCacheDirectory)
         , pathTraceShader(nullptr)
         , pathTraceShaderLowRes(nullptr)
         , outputShader(nullptr)
         , tonemapShader(nullptr)
+        , convergenceShader(nullptr)
+        , tileConvergenceShader(nullptr)
+        , guideTrainShader(nullptr)
+        , pathTraceTextureLowRes(0)
+        , accumTexture(0)
+        , accumMomentsTexture(0)
+        , accumAlbedoTexture(0)
+        , accumNormalTexture(0)
+        , pixelConvergenceTexture(0)
+        , tileConvergenceTexture(0)
+        , previewHistoryTexture(0)
+        , outputTexture(0)
+        , outputHDRTexture(0)
+        , denoiserOutputTexture(0)
+        , denoisedTexture(0)
+        , guideTrainTextures()
+        , tileTimerQueries()
+        , previewTimerQuery(0)
+        , pathGuide(nullptr)
+        , guideIterations(0)
+        , denoiserInputPtr(nullptr)
+        , frameOutputPtr(nullptr)
+        , denoiserPBO(0)
+        , denoiserFence(0)
+        , denoiserDone(false)
+        , denoiseStale(false)
+        , outputReadbacks()
+        , outputReadbackIndex(0)
     {
         if (scene == nullptr)
         {
@@ -75,8 +408,12 @@ namespace GLSLPT
             return;
         }
 
+        // BC1 and BC3 need S3TC, which unlike BC5 is not core
         if (!scene->initialized)
+        {
+            scene->colorCompressionSupported = IsExtensionSupported("GL_EXT_texture_compression_s3tc");
             scene->ProcessScene();
+        }
 
         InitGPUDataBuffers();
         quad = new Quad();
@@ -88,6 +425,9 @@ namespace GLSLPT
 
     Renderer::~Renderer()
     {
+        DeleteDenoiserBuffers();
+        FlushOutputs();
+
         delete quad;
 
         // Delete textures
@@ -99,37 +439,52 @@ namespace GLSLPT
         glDeleteTextures(1, &transformsTex);
         glDeleteTextures(1, &lightsTex);
         glDeleteTextures(1, &textureMapsArrayTex);
+        glDeleteTextures(1, &textureMapsRGArrayTex);
+        glDeleteTextures(1, &textureRectsTex);
         glDeleteTextures(1, &envMapTex);
         glDeleteTextures(1, &envMapCDFTex);
-        glDeleteTextures(1, &pathTraceTexture);
+        glDeleteTextures(1, &blueNoiseTex);
         glDeleteTextures(1, &pathTraceTextureLowRes);
         glDeleteTextures(1, &accumTexture);
-        glDeleteTextures(1, &tileOutputTexture[0]);
-        glDeleteTextures(1, &tileOutputTexture[1]);
-        glDeleteTextures(1, &denoisedTexture);
+        glDeleteTextures(1, &accumMomentsTexture);
+        glDeleteTextures(1, &pixelConvergenceTexture);
+        glDeleteTextures(1, &tileConvergenceTexture);
+        glDeleteTextures(1, &previewHistoryTexture);
+        glDeleteTextures(1, &outputTexture);
+        glDeleteTextures(1, &outputHDRTexture);
+        glDeleteTextures(1, &guideTex);
+        glDeleteTextures(6, guideTrainTextures);
+        for (int i = 0; i < 3; i++)
+            glDeleteBuffers(1, &outputReadbacks[i].pbo);
 
         // Delete buffers
         glDeleteBuffers(1, &BVHBuffer);
         glDeleteBuffers(1, &vertexIndicesBuffer);
         glDeleteBuffers(1, &verticesBuffer);
         glDeleteBuffers(1, &normalsBuffer);
+        glDeleteBuffers(1, &frameUBO);
 
         // Delete FBOs
-        glDeleteFramebuffers(1, &pathTraceFBO);
         glDeleteFramebuffers(1, &pathTraceFBOLowRes);
         glDeleteFramebuffers(1, &accumFBO);
         glDeleteFramebuffers(1, &outputFBO);
+        glDeleteFramebuffers(1, &pixelConvergenceFBO);
+        glDeleteFramebuffers(1, &convergenceFBO);
+        glDeleteFramebuffers(1, &previewHistoryFBO);
+        glDeleteFramebuffers(1, &guideTrainFBO);
+        glDeleteQueries(2, tileTimerQueries);
+        glDeleteQueries(1, &previewTimerQuery);
 
         // Delete shaders
         delete pathTraceShader;
         delete pathTraceShaderLowRes;
         delete outputShader;
         delete tonemapShader;
+        delete convergenceShader;
+        delete tileConvergenceShader;
+        delete guideTrainShader;
 
-        // Delete denoiser data
-        delete[] denoiserInputFramePtr;
-        delete[] frameOutputPtr;
-
+        delete pathGuide;
     }
 
     void Renderer::InitGPUDataBuffers()
@@ -147,7 +502,8 @@ namespace GLSLPT
         // Create buffer and texture for vertex indices
         glGenBuffers(1, &vertexIndicesBuffer);
         glBindBuffer(GL_TEXTURE_BUFFER, vertexIndicesBuffer);
-        glBufferData(GL_TEXTURE_BUFFER, sizeof(Indices) * scene->vertIndices.size(), &scene->vertIndices[0], GL_STATIC_DRAW);
+        BufferView vertIndices = scene->GetBuffer(VertIndicesBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, vertIndices.size, vertIndices.data, GL_STATIC_DRAW);
         glGenTextures(1, &vertexIndicesTex);
         glBindTexture(GL_TEXTURE_BUFFER, vertexIndicesTex);
         glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32I, vertexIndicesBuffer);
@@ -155,7 +511,8 @@ namespace GLSLPT
         // Create buffer and texture for vertices
         glGenBuffers(1, &verticesBuffer);
         glBindBuffer(GL_TEXTURE_BUFFER, verticesBuffer);
-        glBufferData(GL_TEXTURE_BUFFER, sizeof(Vec4) * scene->verticesUVX.size(), &scene->verticesUVX[0], GL_STATIC_DRAW);
+        BufferView verticesUVX = scene->GetBuffer(VerticesUVXBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, verticesUVX.size, verticesUVX.data, GL_STATIC_DRAW);
         glGenTextures(1, &verticesTex);
         glBindTexture(GL_TEXTURE_BUFFER, verticesTex);
         glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, verticesBuffer);
@@ -163,7 +520,8 @@ namespace GLSLPT
         // Create buffer and texture for normals
         glGenBuffers(1, &normalsBuffer);
         glBindBuffer(GL_TEXTURE_BUFFER, normalsBuffer);
-        glBufferData(GL_TEXTURE_BUFFER, sizeof(Vec4) * scene->normalsUVY.size(), &scene->normalsUVY[0], GL_STATIC_DRAW);
+        BufferView normalsUVY = scene->GetBuffer(NormalsUVYBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, normalsUVY.size, normalsUVY.data, GL_STATIC_DRAW);
         glGenTextures(1, &normalsTex);
         glBindTexture(GL_TEXTURE_BUFFER, normalsTex);
         glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, normalsBuffer);
@@ -171,7 +529,7 @@ namespace GLSLPT
         // Create texture for materials
         glGenTextures(1, &materialsTex);
         glBindTexture(GL_TEXTURE_2D, materialsTex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (sizeof(Material) / sizeof(Vec4)) * scene->materials.size(), 1, 0, GL_RGBA, GL_FLOAT, &scene->materials[0]);
+        UploadMaterials(scene->materials, scene->renderOptions.packMaterials);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -199,12 +557,20 @@ namespace GLSLPT
         // Create texture for scene textures
         if (!scene->textures.empty())
         {
-            glGenTextures(1, &textureMapsArrayTex);
-            glBindTexture(GL_TEXTURE_2D_ARRAY, textureMapsArrayTex);
-            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, scene->renderOptions.texArrayWidth, scene->renderOptions.texArrayHeight, scene->textures.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, &scene->textureMapsArray[0]);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            const TextureAtlas& colorAtlas = scene->textureAtlases[ColorAtlas];
+            const TextureAtlas& rgAtlas = scene->textureAtlases[RGAtlas];
+            if (colorAtlas.numPages > 0)
+                textureMapsArrayTex = CreateTextureAtlas(colorAtlas, scene->GetBuffer(ColorAtlasBuffer), scene->renderOptions.texArrayWidth, scene->renderOptions.texArrayHeight);
+            if (rgAtlas.numPages > 0)
+                textureMapsRGArrayTex = CreateTextureAtlas(rgAtlas, scene->GetBuffer(RGAtlasBuffer), scene->renderOptions.texArrayWidth, scene->renderOptions.texArrayHeight);
+
+            // Create texture for locations of textures within the atlas
+            glGenTextures(1, &textureRectsTex);
+            glBindTexture(GL_TEXTURE_2D, textureRectsTex);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (sizeof(TextureRect) / sizeof(Vec4)) * scene->textureRects.size(), 1, 0, GL_RGBA, GL_FLOAT, &scene->textureRects[0]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
         }
 
         // Create texture for environment map
@@ -225,6 +591,18 @@ namespace GLSLPT
             glBindTexture(GL_TEXTURE_2D, 0);
         }
 
+        // Create texture for the blue noise sampler, with two independent rankings per texel
+        std::vector<float> blueNoise(kBlueNoiseSize * kBlueNoiseSize * 2);
+        GenerateBlueNoise(kBlueNoiseSize, 1, &blueNoise[0], 2);
+        GenerateBlueNoise(kBlueNoiseSize, 2, &blueNoise[1], 2);
+
+        glGenTextures(1, &blueNoiseTex);
+        glBindTexture(GL_TEXTURE_2D, blueNoiseTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, kBlueNoiseSize, kBlueNoiseSize, 0, GL_RG, GL_FLOAT, blueNoise.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
         // Bind textures to texture slots as they will not change slots during the lifespan of the renderer
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_BUFFER, BVHTex);
@@ -246,42 +624,60 @@ namespace GLSLPT
         glBindTexture(GL_TEXTURE_2D, envMapTex);
         glActiveTexture(GL_TEXTURE10);
         glBindTexture(GL_TEXTURE_2D, envMapCDFTex);
+        glActiveTexture(GL_TEXTURE11);
+        glBindTexture(GL_TEXTURE_2D, textureRectsTex);
+        glActiveTexture(GL_TEXTURE12);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureMapsRGArrayTex);
+        glActiveTexture(GL_TEXTURE16);
+        glBindTexture(GL_TEXTURE_2D, blueNoiseTex);
+        glActiveTexture(GL_TEXTURE0);
+
+        // Stays bound to its binding point as well, Update rewrites it every frame
+        glGenBuffers(1, &frameUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, kFrameUniformsBinding, frameUBO);
     }
 
     void Renderer::ResizeRenderer()
     {
+        DeleteDenoiserBuffers();
+
+        // Pending readbacks still refer to the old size
+        FlushOutputs();
+
         // Delete textures
-        glDeleteTextures(1, &pathTraceTexture);
         glDeleteTextures(1, &pathTraceTextureLowRes);
         glDeleteTextures(1, &accumTexture);
-        glDeleteTextures(1, &tileOutputTexture[0]);
-        glDeleteTextures(1, &tileOutputTexture[1]);
-        glDeleteTextures(1, &denoisedTexture);
+        glDeleteTextures(1, &accumMomentsTexture);
+        glDeleteTextures(1, &pixelConvergenceTexture);
+        glDeleteTextures(1, &tileConvergenceTexture);
+        glDeleteTextures(1, &previewHistoryTexture);
+        glDeleteTextures(1, &outputTexture);
+        glDeleteTextures(1, &outputHDRTexture);
+        for (int i = 0; i < 3; i++)
+            glDeleteBuffers(1, &outputReadbacks[i].pbo);
 
         // Delete FBOs
-        glDeleteFramebuffers(1, &pathTraceFBO);
         glDeleteFramebuffers(1, &pathTraceFBOLowRes);
         glDeleteFramebuffers(1, &accumFBO);
         glDeleteFramebuffers(1, &outputFBO);
+        glDeleteFramebuffers(1, &pixelConvergenceFBO);
+        glDeleteFramebuffers(1, &convergenceFBO);
+        glDeleteFramebuffers(1, &previewHistoryFBO);
+        glDeleteQueries(2, tileTimerQueries);
+        glDeleteQueries(1, &previewTimerQuery);
 
-        // Delete denoiser data
-        delete[] denoiserInputFramePtr;
-        delete[] frameOutputPtr;
-
-        // Delete shaders
-        delete pathTraceShader;
-        delete pathTraceShaderLowRes;
-        delete outputShader;
-        delete tonemapShader;
-
+        // The shaders don't depend on the size, only some of their uniforms do
         InitFBOs();
-        InitShaders();
+        UpdateRenderSizeUniforms();
     }
 
     void Renderer::InitFBOs()
     {
-        sampleCounter = 1;
-        currentBuffer = 0;
+        // Samples each pixel will have once the current pass over the tiles completes
+        sampleCounter = scene->renderOptions.samplesPerPass;
         frameCounter = 1;
 
         renderSize = scene->renderOptions.renderResolution;
@@ -299,27 +695,32 @@ namespace GLSLPT
         tile.x = -1;
         tile.y = numTiles.y - 1;
 
-        // Create FBOs for path trace shader 
-        glGenFramebuffers(1, &pathTraceFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, pathTraceFBO);
-
-        // Create Texture for FBO
-        glGenTextures(1, &pathTraceTexture);
-        glBindTexture(GL_TEXTURE_2D, pathTraceTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, tileWidth, tileHeight, 0, GL_RGBA, GL_FLOAT, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pathTraceTexture, 0);
-
-        // Create FBOs for low res preview shader 
+        converged = false;
+        tileConverged.assign(numTiles.x * numTiles.y, 0);
+
+        // Tile cost is unknown until the first timer query returns
+        glGenQueries(2, tileTimerQueries);
+        tileTimerTiles[0] = tileTimerTiles[1] = 0;
+        tileTimerIndex = 0;
+        tileTimeEstimate = 0.0f;
+        tilesPerFrame = 1;
+        denoiseFrame = 0;
+        denoiseRequest = 0;
+        denoiseSamples = 0;
+
+        glGenQueries(1, &previewTimerQuery);
+        previewTimerPending = false;
+        previewSize = iVec2(0, 0);
+        previewLevel = 0;
+
+        // Create FBOs for low res preview shader. The preview is rendered into the lower left corner at a varying resolution
         glGenFramebuffers(1, &pathTraceFBOLowRes);
         glBindFramebuffer(GL_FRAMEBUFFER, pathTraceFBOLowRes);
 
         // Create Texture for FBO
         glGenTextures(1, &pathTraceTextureLowRes);
         glBindTexture(GL_TEXTURE_2D, pathTraceTextureLowRes);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, windowSize.x * pixelRatio, windowSize.y * pixelRatio, 0, GL_RGBA, GL_FLOAT, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, windowSize.x * kMaxPreviewRatio, windowSize.y * kMaxPreviewRatio, 0, GL_RGBA, GL_FLOAT, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -327,7 +728,25 @@ namespace GLSLPT
         glBindTexture(GL_TEXTURE_2D, 0);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pathTraceTextureLowRes, 0);
 
-        // Create FBOs for accum buffer
+        // Create FBO for the upsampled previous preview level that a refinement level blends with
+        glGenFramebuffers(1, &previewHistoryFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, previewHistoryFBO);
+
+        glGenTextures(1, &previewHistoryTexture);
+        glBindTexture(GL_TEXTURE_2D, previewHistoryTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, windowSize.x * kMaxPreviewRatio, windowSize.y * kMaxPreviewRatio, 0, GL_RGBA, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, previewHistoryTexture, 0);
+
+        glActiveTexture(GL_TEXTURE14);
+        glBindTexture(GL_TEXTURE_2D, previewHistoryTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        // Create FBOs for accum buffer. Tiles are rendered straight into it with additive blending
         glGenFramebuffers(1, &accumFBO);
         glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
 
@@ -340,62 +759,224 @@ namespace GLSLPT
         glBindTexture(GL_TEXTURE_2D, 0);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
 
-        // Create FBOs for tile output shader
+        if (scene->renderOptions.noiseThreshold > 0.0f)
+        {
+            // Sum of squared luminance and sample count of each pixel for adaptive sampling, accumulated along with the samples
+            glGenTextures(1, &accumMomentsTexture);
+            glBindTexture(GL_TEXTURE_2D, accumMomentsTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, renderSize.x, renderSize.y, 0, GL_RG, GL_FLOAT, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, accumMomentsTexture, 0);
+        }
+
+        // Clear every attachment. InitShaders then enables the ones the tile shader writes to
+        GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_NONE };
+        if (scene->renderOptions.noiseThreshold > 0.0f)
+            drawBuffers[1] = GL_COLOR_ATTACHMENT1;
+        glDrawBuffers(2, drawBuffers);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (scene->renderOptions.noiseThreshold > 0.0f)
+        {
+            // Create FBO for the per pixel convergence mask. Converged pixels are skipped by the tile shader
+            glGenFramebuffers(1, &pixelConvergenceFBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, pixelConvergenceFBO);
+
+            glGenTextures(1, &pixelConvergenceTexture);
+            glBindTexture(GL_TEXTURE_2D, pixelConvergenceTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, renderSize.x, renderSize.y, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pixelConvergenceTexture, 0);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // Create FBO for the per tile convergence flags
+            glGenFramebuffers(1, &convergenceFBO);
+            glBindFramebuffer(GL_FRAMEBUFFER, convergenceFBO);
+
+            glGenTextures(1, &tileConvergenceTexture);
+            glBindTexture(GL_TEXTURE_2D, tileConvergenceTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, numTiles.x, numTiles.y, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tileConvergenceTexture, 0);
+
+            // Read by the convergence, tile and tonemap shaders
+            glActiveTexture(GL_TEXTURE13);
+            glBindTexture(GL_TEXTURE_2D, accumMomentsTexture);
+            glActiveTexture(GL_TEXTURE15);
+            glBindTexture(GL_TEXTURE_2D, pixelConvergenceTexture);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        // Create FBOs for the tonemapped output. It is only updated when a pass over all tiles completes
         glGenFramebuffers(1, &outputFBO);
         glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
 
         // Create Texture for FBO
-        glGenTextures(1, &tileOutputTexture[0]);
-        glBindTexture(GL_TEXTURE_2D, tileOutputTexture[0]);
+        glGenTextures(1, &outputTexture);
+        glBindTexture(GL_TEXTURE_2D, outputTexture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderSize.x, renderSize.y, 0, GL_RGBA, GL_FLOAT, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
 
-        glGenTextures(1, &tileOutputTexture[1]);
-        glBindTexture(GL_TEXTURE_2D, tileOutputTexture[1]);
+        // Linear HDR copy of the output, written by the tonemap pass for saving float images
+        glGenTextures(1, &outputHDRTexture);
+        glBindTexture(GL_TEXTURE_2D, outputHDRTexture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderSize.x, renderSize.y, 0, GL_RGBA, GL_FLOAT, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, outputHDRTexture, 0);
+
+        // Also the pixel estimate for efficiency-aware Russian roulette
+        glActiveTexture(GL_TEXTURE18);
+        glBindTexture(GL_TEXTURE_2D, outputHDRTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        GLenum outputDrawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, outputDrawBuffers);
+
+        if (scene->renderOptions.enableDenoiser)
+            InitDenoiserBuffers();
+
+        // PBOs for saving images, sized for float RGBA
+        int numPixels = renderSize.x * renderSize.y;
+        for (int i = 0; i < 3; i++)
+        {
+            glGenBuffers(1, &outputReadbacks[i].pbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, outputReadbacks[i].pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float) * numPixels * 4, nullptr, GL_STREAM_READ);
+            outputReadbacks[i].fence = 0;
+        }
+        outputReadbackIndex = 0;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        printf("Window Resolution : %d %d\n", windowSize.x, windowSize.y);
+        printf("Render Resolution : %d %d\n", renderSize.x, renderSize.y);
+        printf("Max Preview Resolution : %d %d\n", (int)((float)windowSize.x * kMaxPreviewRatio), (int)((float)windowSize.y * kMaxPreviewRatio));
+        printf("Tile Size : %d %d\n", tileWidth, tileHeight);
+        if (scene->renderOptions.noiseThreshold > 0.0f)
+            printf("Adaptive sampling noise threshold : %g\n", scene->renderOptions.noiseThreshold);
+    }
+
+    void Renderer::InitDenoiserBuffers()
+    {
+        // First hit albedo and normal of each pixel, accumulated as auxiliary inputs for the denoiser
+        glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+
+        glGenTextures(1, &accumAlbedoTexture);
+        glBindTexture(GL_TEXTURE_2D, accumAlbedoTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderSize.x, renderSize.y, 0, GL_RGBA, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, accumAlbedoTexture, 0);
+
+        glGenTextures(1, &accumNormalTexture);
+        glBindTexture(GL_TEXTURE_2D, accumNormalTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderSize.x, renderSize.y, 0, GL_RGBA, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, accumNormalTexture, 0);
+
+        GLenum drawBuffers[] = { GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+        glDrawBuffers(4, drawBuffers);
+        glClear(GL_COLOR_BUFFER_BIT);
 
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tileOutputTexture[currentBuffer], 0);
+        // The input holds the color, albedo and normal images followed by the sample count of each pixel
+        int numPixels = renderSize.x * renderSize.y;
+        denoiserInputPtr = new float[numPixels * 10];
+        frameOutputPtr = new Vec3[numPixels];
+
+        // The denoiser works on HDR data, so its output is tonemapped into denoisedTexture
+        glGenTextures(1, &denoiserOutputTexture);
+        glBindTexture(GL_TEXTURE_2D, denoiserOutputTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, renderSize.x, renderSize.y, 0, GL_RGB, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
 
-        // For Denoiser
-        denoiserInputFramePtr = new Vec3[renderSize.x * renderSize.y];
-        frameOutputPtr = new Vec3[renderSize.x * renderSize.y];
+        glGenFramebuffers(1, &denoisedFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, denoisedFBO);
 
         glGenTextures(1, &denoisedTexture);
         glBindTexture(GL_TEXTURE_2D, denoisedTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, renderSize.x, renderSize.y, 0, GL_RGB, GL_FLOAT, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, renderSize.x, renderSize.y, 0, GL_RGBA, GL_FLOAT, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, denoisedTexture, 0);
 
-        printf("Window Resolution : %d %d\n", windowSize.x, windowSize.y);
-        printf("Render Resolution : %d %d\n", renderSize.x, renderSize.y);
-        printf("Preview Resolution : %d %d\n", (int)((float)windowSize.x * pixelRatio), (int)((float)windowSize.y * pixelRatio));
-        printf("Tile Size : %d %d\n", tileWidth, tileHeight);
+        glGenBuffers(1, &denoiserPBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, denoiserPBO);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float) * numPixels * 10, nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void Renderer::DeleteDenoiserBuffers()
+    {
+        // The filter holds pointers to the denoiser buffers, so it is recreated along with them
+        WaitForDenoiser();
+        denoiserFilter = nullptr;
+        denoised = false;
+
+        glDeleteTextures(1, &accumAlbedoTexture);
+        glDeleteTextures(1, &accumNormalTexture);
+        glDeleteTextures(1, &denoiserOutputTexture);
+        glDeleteTextures(1, &denoisedTexture);
+        glDeleteFramebuffers(1, &denoisedFBO);
+        glDeleteBuffers(1, &denoiserPBO);
+        accumAlbedoTexture = 0;
+        accumNormalTexture = 0;
+        denoiserOutputTexture = 0;
+        denoisedTexture = 0;
+        denoisedFBO = 0;
+        denoiserPBO = 0;
+
+        delete[] denoiserInputPtr;
+        delete[] frameOutputPtr;
+        denoiserInputPtr = nullptr;
+        frameOutputPtr = nullptr;
     }
 
     void Renderer::ReloadShaders()
     {
+        // The denoiser buffers only exist while the denoiser is enabled
+        if (scene->renderOptions.enableDenoiser && !denoisedFBO)
+            InitDenoiserBuffers();
+        else if (!scene->renderOptions.enableDenoiser && denoisedFBO)
+            DeleteDenoiserBuffers();
+
         // Delete shaders
         delete pathTraceShader;
         delete pathTraceShaderLowRes;
         delete outputShader;
         delete tonemapShader;
+        delete convergenceShader;
+        delete tileConvergenceShader;
+        delete guideTrainShader;
 
         InitShaders();
     }
 
     void Renderer::InitShaders()
     {
-        ShaderInclude::ShaderSource vertexShaderSrcObj = ShaderInclude::load(shadersDirectory + "common/vertex.glsl");
-        ShaderInclude::ShaderSource pathTraceShaderSrcObj = ShaderInclude::load(shadersDirectory + "tile.glsl");
-        ShaderInclude::ShaderSource pathTraceShaderLowResSrcObj = ShaderInclude::load(shadersDirectory + "preview.glsl");
-        ShaderInclude::ShaderSource outputShaderSrcObj = ShaderInclude::load(shadersDirectory + "output.glsl");
-        ShaderInclude::ShaderSource tonemapShaderSrcObj = ShaderInclude::load(shadersDirectory + "tonemap.glsl");
+        ShaderInclude::ShaderSource vertexShaderSrcObj = GetShaderSource("common/vertex.glsl");
+        ShaderInclude::ShaderSource pathTraceShaderSrcObj = GetShaderSource("tile.glsl");
+        ShaderInclude::ShaderSource pathTraceShaderLowResSrcObj = GetShaderSource("preview.glsl");
+        ShaderInclude::ShaderSource outputShaderSrcObj = GetShaderSource("output.glsl");
+        ShaderInclude::ShaderSource tonemapShaderSrcObj = GetShaderSource("tonemap.glsl");
+        ShaderInclude::ShaderSource convergenceShaderSrcObj = GetShaderSource("convergence.glsl");
+        ShaderInclude::ShaderSource tileConvergenceShaderSrcObj = GetShaderSource("tileconvergence.glsl");
+        ShaderInclude::ShaderSource guideTrainShaderSrcObj = GetShaderSource("guidetrain.glsl");
 
         // Add preprocessor defines for conditional compilation
         std::string pathtraceDefines = "";
@@ -411,6 +992,9 @@ namespace GLSLPT
         {
             pathtraceDefines += "#define OPT_RR\n";
             pathtraceDefines += "#define OPT_RR_DEPTH " + std::to_string(scene->renderOptions.RRDepth) + "\n";
+
+            if (scene->renderOptions.enableEfficiencyRR)
+                pathtraceDefines += "#define OPT_EFFICIENCY_RR\n";
         }
 
         if (scene->renderOptions.enableUniformLight)
@@ -458,6 +1042,68 @@ namespace GLSLPT
         if (scene->renderOptions.enableVolumeMIS)
             pathtraceDefines += "#define OPT_VOL_MIS\n";
 
+        if (scene->renderOptions.packMaterials)
+            pathtraceDefines += "#define OPT_PACKED_MATERIALS\n";
+
+        if (scene->renderOptions.noiseThreshold > 0.0f)
+        {
+            pathtraceDefines += "#define OPT_ADAPTIVE\n";
+            tonemapDefines += "#define OPT_ADAPTIVE\n";
+        }
+
+        if (scene->renderOptions.enableDenoiser)
+            pathtraceDefines += "#define OPT_DENOISER\n";
+
+        if (scene->renderOptions.sampler == SobolSampler)
+            pathtraceDefines += "#define OPT_SOBOL\n";
+        else if (scene->renderOptions.sampler == BlueNoiseSampler)
+            pathtraceDefines += "#define OPT_BLUE_NOISE\n";
+
+        // The guide is created the first time guiding is enabled and kept across shader reloads
+        if (scene->renderOptions.enablePathGuiding)
+        {
+            if (pathGuide == nullptr)
+                InitPathGuide();
+
+            pathtraceDefines += "#define OPT_GUIDING\n";
+            pathtraceDefines += "#define OPT_GUIDING_RES " + std::to_string(kGuideDirRes) + "\n";
+        }
+
+        // Disney BSDF lobes and texture fetches that no material uses are compiled out
+        bool clearcoat = false, sheen = false, specTrans = false, aniso = false;
+        for (int i = 0; i < scene->materials.size(); i++)
+        {
+            const Material& mat = scene->materials[i];
+            clearcoat |= mat.clearcoat > 0.0f;
+            sheen |= mat.sheen > 0.0f;
+            specTrans |= mat.specTrans > 0.0f;
+            aniso |= mat.anisotropic > 0.0f;
+        }
+
+        if (clearcoat)
+            pathtraceDefines += "#define OPT_CLEARCOAT\n";
+
+        if (sheen)
+            pathtraceDefines += "#define OPT_SHEEN\n";
+
+        if (specTrans)
+            pathtraceDefines += "#define OPT_SPEC_TRANS\n";
+
+        if (aniso)
+            pathtraceDefines += "#define OPT_ANISO\n";
+
+        if (!scene->textures.empty())
+            pathtraceDefines += "#define OPT_TEXTURES\n";
+
+        // Report which variant of the path tracing shader is built for this scene
+        std::string variant;
+        for (size_t pos = pathtraceDefines.find("#define "); pos != std::string::npos; pos = pathtraceDefines.find("#define ", pos + 1))
+        {
+            size_t end = pathtraceDefines.find("\n", pos);
+            variant += " " + pathtraceDefines.substr(pos + 8, end - pos - 8);
+        }
+        printf("Path trace shader variant:%s\n", variant.empty() ? " (no options)" : variant.c_str());
+
         if (pathtraceDefines.size() > 0)
         {
             size_t idx = pathTraceShaderSrcObj.src.find("#version");
@@ -473,6 +1119,13 @@ namespace GLSLPT
             else
                 idx = 0;
             pathTraceShaderLowResSrcObj.src.insert(idx + 1, pathtraceDefines);
+
+            idx = guideTrainShaderSrcObj.src.find("#version");
+            if (idx != -1)
+                idx = guideTrainShaderSrcObj.src.find("\n", idx);
+            else
+                idx = 0;
+            guideTrainShaderSrcObj.src.insert(idx + 1, pathtraceDefines + "#define OPT_GUIDING_TRAIN " + std::to_string(kGuideTrainVertices) + "\n");
         }
 
         if (tonemapDefines.size() > 0)
@@ -485,10 +1138,21 @@ namespace GLSLPT
             tonemapShaderSrcObj.src.insert(idx + 1, tonemapDefines);
         }
 
-        pathTraceShader = LoadShaders(vertexShaderSrcObj, pathTraceShaderSrcObj);
-        pathTraceShaderLowRes = LoadShaders(vertexShaderSrcObj, pathTraceShaderLowResSrcObj);
-        outputShader = LoadShaders(vertexShaderSrcObj, outputShaderSrcObj);
-        tonemapShader = LoadShaders(vertexShaderSrcObj, tonemapShaderSrcObj);
+        pathTraceShader = LoadShaders(vertexShaderSrcObj, pathTraceShaderSrcObj, shaderCacheDirectory);
+        pathTraceShaderLowRes = LoadShaders(vertexShaderSrcObj, pathTraceShaderLowResSrcObj, shaderCacheDirectory);
+        outputShader = LoadShaders(vertexShaderSrcObj, outputShaderSrcObj, shaderCacheDirectory);
+        tonemapShader = LoadShaders(vertexShaderSrcObj, tonemapShaderSrcObj, shaderCacheDirectory);
+        convergenceShader = LoadShaders(vertexShaderSrcObj, convergenceShaderSrcObj, shaderCacheDirectory);
+        tileConvergenceShader = LoadShaders(vertexShaderSrcObj, tileConvergenceShaderSrcObj, shaderCacheDirectory);
+        guideTrainShader = scene->renderOptions.enablePathGuiding ? LoadShaders(vertexShaderSrcObj, guideTrainShaderSrcObj, shaderCacheDirectory) : nullptr;
+
+        Program* frameShaders[] = { pathTraceShader, pathTraceShaderLowRes, guideTrainShader };
+        for (Program* shader : frameShaders)
+        {
+            GLuint blockIndex = shader ? glGetUniformBlockIndex(shader->getObject(), "FrameUniforms") : GL_INVALID_INDEX;
+            if (blockIndex != GL_INVALID_INDEX)
+                glUniformBlockBinding(shader->getObject(), blockIndex, kFrameUniformsBinding);
+        }
 
         // Setup shader uniforms
         GLuint shaderObject;
@@ -502,10 +1166,7 @@ namespace GLSLPT
         }
         
         glUniform1i(glGetUniformLocation(shaderObject, "topBVHIndex"), scene->bvhTranslator.topLevelIndex);
-        glUniform2f(glGetUniformLocation(shaderObject, "resolution"), float(renderSize.x), float(renderSize.y));
-        glUniform2f(glGetUniformLocation(shaderObject, "invNumTiles"), invNumTiles.x, invNumTiles.y);
         glUniform1i(glGetUniformLocation(shaderObject, "numOfLights"), scene->lights.size());
-        glUniform1i(glGetUniformLocation(shaderObject, "accumTexture"), 0);
         glUniform1i(glGetUniformLocation(shaderObject, "BVH"), 1);
         glUniform1i(glGetUniformLocation(shaderObject, "vertexIndicesTex"), 2);
         glUniform1i(glGetUniformLocation(shaderObject, "verticesTex"), 3);
@@ -516,6 +1177,11 @@ namespace GLSLPT
         glUniform1i(glGetUniformLocation(shaderObject, "textureMapsArrayTex"), 8);
         glUniform1i(glGetUniformLocation(shaderObject, "envMapTex"), 9);
         glUniform1i(glGetUniformLocation(shaderObject, "envMapCDFTex"), 10);
+        glUniform1i(glGetUniformLocation(shaderObject, "textureRectsTex"), 11);
+        glUniform1i(glGetUniformLocation(shaderObject, "textureMapsRGArrayTex"), 12);
+        glUniform1i(glGetUniformLocation(shaderObject, "blueNoiseTex"), 16);
+        glUniform1i(glGetUniformLocation(shaderObject, "pixelConvergenceTexture"), 15);
+        glUniform1i(glGetUniformLocation(shaderObject, "pixelEstimateTexture"), 18);
         pathTraceShader->StopUsing();
 
         pathTraceShaderLowRes->Use();
@@ -527,9 +1193,7 @@ namespace GLSLPT
             glUniform1f(glGetUniformLocation(shaderObject, "envMapTotalSum"), scene->envMap->totalSum);
         }
         glUniform1i(glGetUniformLocation(shaderObject, "topBVHIndex"), scene->bvhTranslator.topLevelIndex);
-        glUniform2f(glGetUniformLocation(shaderObject, "resolution"), float(renderSize.x), float(renderSize.y));
         glUniform1i(glGetUniformLocation(shaderObject, "numOfLights"), scene->lights.size());
-        glUniform1i(glGetUniformLocation(shaderObject, "accumTexture"), 0);
         glUniform1i(glGetUniformLocation(shaderObject, "BVH"), 1);
         glUniform1i(glGetUniformLocation(shaderObject, "vertexIndicesTex"), 2);
         glUniform1i(glGetUniformLocation(shaderObject, "verticesTex"), 3);
@@ -540,53 +1204,235 @@ namespace GLSLPT
         glUniform1i(glGetUniformLocation(shaderObject, "textureMapsArrayTex"), 8);
         glUniform1i(glGetUniformLocation(shaderObject, "envMapTex"), 9);
         glUniform1i(glGetUniformLocation(shaderObject, "envMapCDFTex"), 10);
+        glUniform1i(glGetUniformLocation(shaderObject, "textureRectsTex"), 11);
+        glUniform1i(glGetUniformLocation(shaderObject, "textureMapsRGArrayTex"), 12);
+        glUniform1i(glGetUniformLocation(shaderObject, "blueNoiseTex"), 16);
+        glUniform1i(glGetUniformLocation(shaderObject, "previewHistoryTexture"), 14);
         pathTraceShaderLowRes->StopUsing();
-    }
-
-    void Renderer::Render()
-    {
-        // If maxSpp was reached then stop rendering. 
-        // TODO: Tonemapping and denosing still need to be able to run on final image
-        if (!scene->dirty && scene->renderOptions.maxSpp != -1 && sampleCounter >= scene->renderOptions.maxSpp)
-            return;
-
-        glActiveTexture(GL_TEXTURE0);
 
-        if (scene->dirty)
+        if (guideTrainShader)
         {
-            // Renders a low res preview if camera/instances are modified
-            glBindFramebuffer(GL_FRAMEBUFFER, pathTraceFBOLowRes);
-            glViewport(0, 0, windowSize.x * pixelRatio, windowSize.y * pixelRatio);
-            quad->Draw(pathTraceShaderLowRes);
+            guideTrainShader->Use();
+            shaderObject = guideTrainShader->getObject();
 
-            scene->instancesModified = false;
-            scene->dirty = false;
-            scene->envMapModified = false;
-        }
-        else
-        {
-            // Renders to pathTraceTexture while using previously accumulated samples from accumTexture
-            // Rendering is done a tile per frame, so if a 500x500 image is rendered with a tileWidth and tileHeight of 250 then, all tiles (for a single sample) 
-            // get rendered after 4 frames
-            glBindFramebuffer(GL_FRAMEBUFFER, pathTraceFBO);
-            glViewport(0, 0, tileWidth, tileHeight);
-            glBindTexture(GL_TEXTURE_2D, accumTexture);
-            quad->Draw(pathTraceShader);
+            if (scene->envMap)
+            {
+                glUniform2f(glGetUniformLocation(shaderObject, "envMapRes"), (float)scene->envMap->width, (float)scene->envMap->height);
+                glUniform1f(glGetUniformLocation(shaderObject, "envMapTotalSum"), scene->envMap->totalSum);
+            }
 
-            // pathTraceTexture is copied to accumTexture and re-used as input for the first step.
-            glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
-            glViewport(tileWidth * tile.x, tileHeight * tile.y, tileWidth, tileHeight);
-            glBindTexture(GL_TEXTURE_2D, pathTraceTexture);
-            quad->Draw(outputShader);
+            glUniform1i(glGetUniformLocation(shaderObject, "topBVHIndex"), scene->bvhTranslator.topLevelIndex);
+            glUniform1i(glGetUniformLocation(shaderObject, "numOfLights"), scene->lights.size());
+            glUniform1i(glGetUniformLocation(shaderObject, "BVH"), 1);
+            glUniform1i(glGetUniformLocation(shaderObject, "vertexIndicesTex"), 2);
+            glUniform1i(glGetUniformLocation(shaderObject, "verticesTex"), 3);
+            glUniform1i(glGetUniformLocation(shaderObject, "normalsTex"), 4);
+            glUniform1i(glGetUniformLocation(shaderObject, "materialsTex"), 5);
+            glUniform1i(glGetUniformLocation(shaderObject, "transformsTex"), 6);
+            glUniform1i(glGetUniformLocation(shaderObject, "lightsTex"), 7);
+            glUniform1i(glGetUniformLocation(shaderObject, "textureMapsArrayTex"), 8);
+            glUniform1i(glGetUniformLocation(shaderObject, "envMapTex"), 9);
+            glUniform1i(glGetUniformLocation(shaderObject, "envMapCDFTex"), 10);
+            glUniform1i(glGetUniformLocation(shaderObject, "textureRectsTex"), 11);
+            glUniform1i(glGetUniformLocation(shaderObject, "textureMapsRGArrayTex"), 12);
+            glUniform1i(glGetUniformLocation(shaderObject, "blueNoiseTex"), 16);
+            guideTrainShader->StopUsing();
+
+            // The grid of the guide is the same for every shader that samples it
+            Program* guidedShaders[] = { pathTraceShader, pathTraceShaderLowRes, guideTrainShader };
+            for (Program* shader : guidedShaders)
+            {
+                shader->Use();
+                shaderObject = shader->getObject();
+                glUniform1i(glGetUniformLocation(shaderObject, "guideTex"), 17);
+                glUniform3f(glGetUniformLocation(shaderObject, "guideGridMin"), pathGuide->gridMin.x, pathGuide->gridMin.y, pathGuide->gridMin.z);
+                glUniform3f(glGetUniformLocation(shaderObject, "guideInvCellSize"), pathGuide->invCellSize.x, pathGuide->invCellSize.y, pathGuide->invCellSize.z);
+                glUniform3i(glGetUniformLocation(shaderObject, "guideGridRes"), pathGuide->gridRes[0], pathGuide->gridRes[1], pathGuide->gridRes[2]);
+                shader->StopUsing();
+            }
+        }
 
-            // Here we render to tileOutputTexture[currentBuffer] but display tileOutputTexture[1-currentBuffer] until all tiles are done rendering
-            // When all tiles are rendered, we flip the bound texture and start rendering to the other one
-            glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tileOutputTexture[currentBuffer], 0);
-            glViewport(0, 0, renderSize.x, renderSize.y);
-            glBindTexture(GL_TEXTURE_2D, accumTexture);
-            quad->Draw(tonemapShader);
+        tonemapShader->Use();
+        shaderObject = tonemapShader->getObject();
+        glUniform1i(glGetUniformLocation(shaderObject, "accumMomentsTexture"), 13);
+        glUniform2f(glGetUniformLocation(shaderObject, "texCoordScale"), 1.0f, 1.0f);
+        tonemapShader->StopUsing();
+
+        convergenceShader->Use();
+        shaderObject = convergenceShader->getObject();
+        glUniform1i(glGetUniformLocation(shaderObject, "accumTexture"), 0);
+        glUniform1i(glGetUniformLocation(shaderObject, "accumMomentsTexture"), 13);
+        glUniform1f(glGetUniformLocation(shaderObject, "noiseThreshold"), scene->renderOptions.noiseThreshold);
+        glUniform1i(glGetUniformLocation(shaderObject, "adaptiveMinSpp"), kAdaptiveMinSpp);
+        convergenceShader->StopUsing();
+
+        tileConvergenceShader->Use();
+        shaderObject = tileConvergenceShader->getObject();
+        glUniform1i(glGetUniformLocation(shaderObject, "pixelConvergenceTexture"), 15);
+        tileConvergenceShader->StopUsing();
+
+        UpdateRenderSizeUniforms();
+    }
+
+    ShaderInclude::ShaderSource Renderer::GetShaderSource(const std::string& file)
+    {
+        // Includes are only expanded the first time, the defines are added to a copy
+        auto it = shaderSources.find(file);
+        if (it == shaderSources.end())
+            it = shaderSources.insert(std::make_pair(file, ShaderInclude::load(shadersDirectory + file))).first;
+        return it->second;
+    }
+
+    void Renderer::UpdateRenderSizeUniforms()
+    {
+        // Route the outputs of this tile shader variant to the accumulation textures
+        GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_NONE, GL_NONE, GL_NONE };
+        if (scene->renderOptions.noiseThreshold > 0.0f)
+            drawBuffers[1] = GL_COLOR_ATTACHMENT1;
+        if (scene->renderOptions.enableDenoiser)
+        {
+            drawBuffers[2] = GL_COLOR_ATTACHMENT2;
+            drawBuffers[3] = GL_COLOR_ATTACHMENT3;
         }
+        glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+        glDrawBuffers(4, drawBuffers);
+
+        GLuint shaderObject;
+        pathTraceShader->Use();
+        shaderObject = pathTraceShader->getObject();
+        glUniform2f(glGetUniformLocation(shaderObject, "resolution"), float(renderSize.x), float(renderSize.y));
+        glUniform2f(glGetUniformLocation(shaderObject, "invNumTiles"), invNumTiles.x, invNumTiles.y);
+        pathTraceShader->StopUsing();
+
+        pathTraceShaderLowRes->Use();
+        shaderObject = pathTraceShaderLowRes->getObject();
+        glUniform2f(glGetUniformLocation(shaderObject, "resolution"), float(renderSize.x), float(renderSize.y));
+        pathTraceShaderLowRes->StopUsing();
+
+        if (guideTrainShader)
+        {
+            // Training covers the whole frame at a low resolution, the aspect ratio is the one of the image
+            guideTrainShader->Use();
+            shaderObject = guideTrainShader->getObject();
+            glUniform2f(glGetUniformLocation(shaderObject, "resolution"), float(renderSize.x), float(renderSize.y));
+            guideTrainShader->StopUsing();
+        }
+
+        tileConvergenceShader->Use();
+        shaderObject = tileConvergenceShader->getObject();
+        glUniform2i(glGetUniformLocation(shaderObject, "tileSize"), tileWidth, tileHeight);
+        tileConvergenceShader->StopUsing();
+    }
+
+    void Renderer::Render()
+    {
+        // If maxSpp was reached or every pixel converged then stop rendering. 
+        // TODO: Tonemapping and denosing still need to be able to run on final image
+        if (IsFinished())
+            return;
+
+        glActiveTexture(GL_TEXTURE0);
+
+        if (scene->dirty)
+        {
+            // Renders a low res preview if camera/instances are modified. Its resolution is adjusted to the frame budget
+            bool timed = !previewTimerPending;
+            if (timed)
+            {
+                glBeginQuery(GL_TIME_ELAPSED, previewTimerQuery);
+                previewTimerRatio = pixelRatio;
+            }
+
+            RenderPreview(pixelRatio, false);
+
+            if (timed)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                previewTimerPending = true;
+            }
+
+            scene->instancesModified = false;
+            scene->dirty = false;
+            scene->envMapModified = false;
+        }
+        else if (previewLevel < kNumPreviewRefineLevels)
+        {
+            // Once the camera stops, the preview is refined at full depth with each level reusing the previous one
+            RenderPreview(kPreviewRefineRatios[previewLevel], previewLevel > 0);
+            previewLevel++;
+        }
+        else
+        {
+            // Tiles rendered in this frame are timed, unless the query is still in flight from an earlier frame
+            bool timed = tileTimerTiles[tileTimerIndex] == 0;
+            if (timed)
+                glBeginQuery(GL_TIME_ELAPSED, tileTimerQueries[tileTimerIndex]);
+
+            // Samples are added straight into accumTexture (and the moments for adaptive sampling) by blending
+            glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+
+            int numTilesRendered = 0;
+            while (true)
+            {
+                // Rendering is done a few tiles per frame, so if a 500x500 image is rendered with a tileWidth and tileHeight of 250 and one tile fits
+                // in the frame budget then, all tiles (for a single sample) get rendered after 4 frames
+                glViewport(tileWidth * tile.x, tileHeight * tile.y, tileWidth, tileHeight);
+                quad->Draw(pathTraceShader);
+
+                // Keep rendering tiles until the frame budget is used up. A frame never continues past the
+                // last tile of a pass so that Update can flip the output buffers on completion
+                if (++numTilesRendered >= tilesPerFrame)
+                    break;
+
+                iVec2 prevTile = tile;
+                if (!NextTile())
+                {
+                    tile = prevTile;
+                    break;
+                }
+
+                frameCounter++;
+                pathTraceShader->Use();
+                glUniform2f(pathTraceShader->GetUniformLocation("tileOffset"), (float)tile.x * invNumTiles.x, (float)tile.y * invNumTiles.y);
+                pathTraceShader->StopUsing();
+            }
+
+            glDisable(GL_BLEND);
+
+            if (timed)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                tileTimerTiles[tileTimerIndex] = numTilesRendered;
+                tileTimerIndex = 1 - tileTimerIndex;
+            }
+        }
+    }
+
+    void Renderer::RenderPreview(float ratio, bool reuseHistory)
+    {
+        iVec2 size = iVec2(std::max(1, (int)(windowSize.x * ratio)), std::max(1, (int)(windowSize.y * ratio)));
+        iVec2 texSize = iVec2(windowSize.x * kMaxPreviewRatio, windowSize.y * kMaxPreviewRatio);
+
+        // The previous level is upsampled to the new resolution and blended with the new samples
+        if (reuseHistory)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, pathTraceFBOLowRes);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previewHistoryFBO);
+            glBlitFramebuffer(0, 0, previewSize.x, previewSize.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+
+        previewSize = size;
+
+        pathTraceShaderLowRes->Use();
+        glUniform1f(pathTraceShaderLowRes->GetUniformLocation("previewHistoryWeight"), reuseHistory ? 0.5f : 0.0f);
+        glUniform2f(pathTraceShaderLowRes->GetUniformLocation("previewScale"), (float)size.x / texSize.x, (float)size.y / texSize.y);
+        pathTraceShaderLowRes->StopUsing();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, pathTraceFBOLowRes);
+        glViewport(0, 0, size.x, size.y);
+        quad->Draw(pathTraceShaderLowRes);
     }
 
     void Renderer::Present()
@@ -594,17 +1440,30 @@ namespace GLSLPT
         glActiveTexture(GL_TEXTURE0);
 
         // For the first sample or if the camera is moving, we do not have an image ready with all the tiles rendered, so we display a low res preview.
-        if (scene->dirty || sampleCounter == 1)
+        if (scene->dirty || sampleCounter <= scene->renderOptions.samplesPerPass)
         {
+            // The preview has a single sample per pixel, no moments and only covers part of its texture
+            iVec2 texSize = iVec2(windowSize.x * kMaxPreviewRatio, windowSize.y * kMaxPreviewRatio);
+            tonemapShader->Use();
+            glUniform1f(tonemapShader->GetUniformLocation("invSampleCounter"), 1.0f);
+            glUniform1i(tonemapShader->GetUniformLocation("usePixelSampleCount"), false);
+            glUniform2f(tonemapShader->GetUniformLocation("texCoordScale"), (float)previewSize.x / texSize.x, (float)previewSize.y / texSize.y);
+            tonemapShader->StopUsing();
+
             glBindTexture(GL_TEXTURE_2D, pathTraceTextureLowRes);
             quad->Draw(tonemapShader);
+
+            tonemapShader->Use();
+            glUniform1i(tonemapShader->GetUniformLocation("usePixelSampleCount"), scene->renderOptions.noiseThreshold > 0.0f);
+            glUniform2f(tonemapShader->GetUniformLocation("texCoordScale"), 1.0f, 1.0f);
+            tonemapShader->StopUsing();
         }
         else
         {
             if (scene->renderOptions.enableDenoiser && denoised)
                 glBindTexture(GL_TEXTURE_2D, denoisedTexture);
             else
-                glBindTexture(GL_TEXTURE_2D, tileOutputTexture[1 - currentBuffer]);
+                glBindTexture(GL_TEXTURE_2D, outputTexture);
 
             quad->Draw(outputShader);
         }
@@ -613,24 +1472,98 @@ namespace GLSLPT
     float Renderer::GetProgress()
     {
         int maxSpp = scene->renderOptions.maxSpp;
-        return maxSpp <= 0 ? 0.0f : sampleCounter * 100.0f / maxSpp;
+        return maxSpp <= 0 ? 0.0f : (sampleCounter - scene->renderOptions.samplesPerPass) * 100.0f / maxSpp;
     }
 
-    void Renderer::GetOutputBuffer(unsigned char** data, int& w, int& h)
+    void Renderer::SaveOutput(const std::string& filename)
     {
-        w = renderSize.x;
-        h = renderSize.y;
+        // Raw accumulations aren't read back asynchronously, they are only saved once at the end of a render
+        if (filename.substr(filename.find_last_of(".") + 1) == "accum")
+        {
+            SaveAccumulation(filename);
+            return;
+        }
+
+        // The oldest readback is only waited on when all PBOs are in flight
+        OutputReadback& readback = outputReadbacks[outputReadbackIndex];
+        if (readback.fence)
+            FinishOutputReadback(readback);
 
-        *data = new unsigned char[w * h * 4];
+        bool useDenoised = scene->renderOptions.enableDenoiser && denoised;
+        readback.filename = filename;
+        readback.hdr = ImageWriter::IsFloatFormat(filename);
 
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
         glActiveTexture(GL_TEXTURE0);
 
-        if (scene->renderOptions.enableDenoiser && denoised)
-            glBindTexture(GL_TEXTURE_2D, denoisedTexture);
+        // Float formats get the linear image, the others the tonemapped one
+        if (readback.hdr)
+        {
+            glBindTexture(GL_TEXTURE_2D, useDenoised ? denoiserOutputTexture : outputHDRTexture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, 0);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, useDenoised ? denoisedTexture : outputTexture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        outputReadbackIndex = (outputReadbackIndex + 1) % 3;
+    }
+
+    void Renderer::FlushOutputs()
+    {
+        // Readbacks are finished oldest first so images are written in the order they were saved
+        for (int i = 0; i < 3; i++)
+        {
+            OutputReadback& readback = outputReadbacks[(outputReadbackIndex + i) % 3];
+            if (readback.fence)
+                FinishOutputReadback(readback);
+        }
+
+        imageWriter.Wait();
+    }
+
+    void Renderer::UpdateOutputs()
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            OutputReadback& readback = outputReadbacks[(outputReadbackIndex + i) % 3];
+            if (readback.fence && glClientWaitSync(readback.fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+                FinishOutputReadback(readback);
+        }
+    }
+
+    void Renderer::FinishOutputReadback(OutputReadback& readback)
+    {
+        glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+
+        int numPixels = renderSize.x * renderSize.y;
+        size_t size = (readback.hdr ? sizeof(float) : 1) * numPixels * 4;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+        // Encoding and file IO happen on the writer thread
+        if (readback.hdr)
+        {
+            std::vector<float> pixels(numPixels * 4);
+            memcpy(pixels.data(), data, size);
+            imageWriter.Write(readback.filename, renderSize.x, renderSize.y, std::move(pixels));
+        }
         else
-            glBindTexture(GL_TEXTURE_2D, tileOutputTexture[1 - currentBuffer]);
+        {
+            std::vector<unsigned char> pixels(numPixels * 4);
+            memcpy(pixels.data(), data, size);
+            imageWriter.Write(readback.filename, renderSize.x, renderSize.y, std::move(pixels));
+        }
 
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, *data);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     }
 
     int Renderer::GetSampleCount()
@@ -638,12 +1571,750 @@ namespace GLSLPT
         return sampleCounter;
     }
 
+    unsigned long long Renderer::ComputeSceneHash()
+    {
+        // Covers everything that changes what a sample adds to the accumulation
+        unsigned long long hash = Math::HashSeed;
+        for (SceneBuffer buffer : { VertIndicesBuffer, VerticesUVXBuffer, NormalsUVYBuffer })
+        {
+            BufferView view = scene->GetBuffer(buffer);
+            hash = Math::HashBytes(hash, view.data, view.size);
+        }
+        hash = Math::HashBytes(hash, scene->transforms.data(), sizeof(Mat4) * scene->transforms.size());
+        hash = Math::HashBytes(hash, scene->lights.data(), sizeof(Light) * scene->lights.size());
+
+        for (Material mat : scene->materials)
+        {
+            mat.padding1 = mat.padding2 = 0.0f;
+            hash = Math::HashBytes(hash, &mat, sizeof(Material));
+        }
+
+        const Camera* camera = scene->camera;
+        float cameraParams[] = {
+            camera->position.x, camera->position.y, camera->position.z,
+            camera->forward.x, camera->forward.y, camera->forward.z,
+            camera->up.x, camera->up.y, camera->up.z,
+            camera->fov, camera->focalDist, camera->aperture
+        };
+        hash = Math::HashBytes(hash, cameraParams, sizeof(cameraParams));
+
+        if (scene->envMap)
+            hash = Math::HashBytes(hash, &scene->envMap->totalSum, sizeof(float));
+
+        const RenderOptions& options = scene->renderOptions;
+        float optionParams[] = {
+            (float)options.maxDepth, (float)options.samplesPerPass, (float)options.enableRR, (float)options.RRDepth, (float)options.enableEfficiencyRR,
+            (float)options.enableEnvMap, options.envMapIntensity, options.envMapRot,
+            (float)options.enableUniformLight, options.uniformLightCol.x, options.uniformLightCol.y, options.uniformLightCol.z,
+            (float)options.hideEmitters, (float)options.enableBackground, (float)options.transparentBackground,
+            (float)options.enableRoughnessMollification, options.roughnessMollificationAmt, (float)options.enableVolumeMIS,
+            (float)options.sampler, (float)options.enablePathGuiding
+        };
+        hash = Math::HashBytes(hash, optionParams, sizeof(optionParams));
+
+        return hash;
+    }
+
+    unsigned long long Renderer::ComputeCheckpointHash()
+    {
+        // Resuming also needs the same tiles, passes and sample indices as the interrupted render
+        const RenderOptions& options = scene->renderOptions;
+        int layoutParams[] = { options.samplesPerPass, options.sampleOffset, options.tileWidth, options.tileHeight };
+        return Math::HashBytes(ComputeSceneHash(), layoutParams, sizeof(layoutParams));
+    }
+
+    bool Renderer::SaveCheckpoint(const std::string& filename)
+    {
+        // There is nothing to keep while the preview is shown
+        if (scene->dirty || previewLevel < kNumPreviewRefineLevels)
+            return false;
+
+        CheckpointHeader header;
+        memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+        header.version = kCheckpointVersion;
+        header.flags = (scene->renderOptions.noiseThreshold > 0.0f ? 1 : 0) | (scene->renderOptions.enableDenoiser ? 2 : 0);
+        header.sceneHash = ComputeCheckpointHash();
+        header.width = renderSize.x;
+        header.height = renderSize.y;
+        header.sampleCounter = sampleCounter;
+        header.frameCounter = frameCounter;
+        header.tileX = tile.x;
+        header.tileY = tile.y;
+
+        // Written to a temporary file first, so a process killed while writing leaves the previous checkpoint intact
+        std::string tempFilename = filename + ".tmp";
+        FILE* file = fopen(tempFilename.c_str(), "wb");
+        if (!file)
+        {
+            printf("Unable to write checkpoint %s\n", tempFilename.c_str());
+            return false;
+        }
+
+        fwrite(&header, sizeof(header), 1, file);
+
+        int numPixels = renderSize.x * renderSize.y;
+        std::vector<float> data(numPixels * 4);
+        glActiveTexture(GL_TEXTURE0);
+
+        auto writeTexture = [&](GLuint texture, GLenum format, int numChannels)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glGetTexImage(GL_TEXTURE_2D, 0, format, GL_FLOAT, data.data());
+            fwrite(data.data(), sizeof(float), numPixels * numChannels, file);
+        };
+
+        writeTexture(accumTexture, GL_RGBA, 4);
+        if (header.flags & 1)
+            writeTexture(accumMomentsTexture, GL_RG, 2);
+        if (header.flags & 2)
+        {
+            writeTexture(accumAlbedoTexture, GL_RGB, 3);
+            writeTexture(accumNormalTexture, GL_RGB, 3);
+        }
+
+        bool success = ferror(file) == 0;
+        fclose(file);
+
+        // rename() does not replace an existing file on every platform
+        if (success)
+        {
+            remove(filename.c_str());
+            success = rename(tempFilename.c_str(), filename.c_str()) == 0;
+        }
+
+        if (success)
+            printf("Checkpoint saved: %s (%d spp)\n", filename.c_str(), sampleCounter);
+        else
+            printf("Unable to write checkpoint %s\n", filename.c_str());
+
+        return success;
+    }
+
+    bool Renderer::LoadCheckpoint(const std::string& filename)
+    {
+        FILE* file = fopen(filename.c_str(), "rb");
+        if (!file)
+        {
+            printf("No checkpoint found at %s\n", filename.c_str());
+            return false;
+        }
+
+        CheckpointHeader header;
+        int flags = (scene->renderOptions.noiseThreshold > 0.0f ? 1 : 0) | (scene->renderOptions.enableDenoiser ? 2 : 0);
+
+        if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, kCheckpointMagic, sizeof(header.magic)) || header.version != kCheckpointVersion)
+        {
+            printf("Invalid checkpoint %s\n", filename.c_str());
+            fclose(file);
+            return false;
+        }
+
+        if (header.sceneHash != ComputeCheckpointHash() || header.flags != flags || header.width != renderSize.x || header.height != renderSize.y)
+        {
+            printf("Checkpoint %s was rendered with a different scene or settings\n", filename.c_str());
+            fclose(file);
+            return false;
+        }
+
+        int numPixels = renderSize.x * renderSize.y;
+        std::vector<float> data(numPixels * 4);
+        bool success = true;
+        glActiveTexture(GL_TEXTURE0);
+
+        auto readTexture = [&](GLuint texture, GLenum format, int numChannels)
+        {
+            success = success && fread(data.data(), sizeof(float), numPixels * numChannels, file) == numPixels * numChannels;
+            if (success)
+            {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderSize.x, renderSize.y, format, GL_FLOAT, data.data());
+            }
+        };
+
+        readTexture(accumTexture, GL_RGBA, 4);
+        if (flags & 1)
+            readTexture(accumMomentsTexture, GL_RG, 2);
+        if (flags & 2)
+        {
+            readTexture(accumAlbedoTexture, GL_RGB, 3);
+            readTexture(accumNormalTexture, GL_RGB, 3);
+        }
+
+        fclose(file);
+
+        if (!success)
+        {
+            printf("Checkpoint %s is truncated\n", filename.c_str());
+            glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+            glClear(GL_COLOR_BUFFER_BIT);
+            return false;
+        }
+
+        // Rendering continues with the next tile. Samples are seeded by their index, so resumed passes match an uninterrupted render
+        sampleCounter = header.sampleCounter;
+        frameCounter = header.frameCounter;
+        tile = iVec2(header.tileX, header.tileY);
+        previewLevel = kNumPreviewRefineLevels;
+        scene->dirty = false;
+
+        // Samples from completed passes are shown until the current pass completes
+        int numSamples = sampleCounter - scene->renderOptions.samplesPerPass;
+        UpdateTonemapUniforms();
+        if (numSamples > 0)
+            TonemapOutput(numSamples);
+
+        if (scene->renderOptions.noiseThreshold > 0.0f && numSamples > kAdaptiveMinSpp)
+            UpdateTileConvergence();
+
+        // A render that had already finished still gets its final denoise
+        if (scene->renderOptions.enableDenoiser && IsFinished() && numSamples > 0)
+            denoiseRequest = numSamples;
+
+        printf("Resumed from checkpoint %s (%d spp)\n", filename.c_str(), sampleCounter);
+        return true;
+    }
+
+    bool Renderer::SaveAccumulation(const std::string& filename)
+    {
+        // Passes are always rendered in full, so a partially rendered pass would give tiles different sample counts
+        if (!IsFinished())
+        {
+            printf("Accumulation %s can only be saved once rendering has finished\n", filename.c_str());
+            return false;
+        }
+
+        AccumulationHeader header;
+        memcpy(header.magic, kAccumulationMagic, sizeof(header.magic));
+        header.version = kAccumulationVersion;
+        header.flags = scene->renderOptions.noiseThreshold > 0.0f ? 1 : 0;
+        header.sceneHash = ComputeSceneHash();
+        header.width = renderSize.x;
+        header.height = renderSize.y;
+        header.sampleOffset = scene->renderOptions.sampleOffset;
+        header.numSamples = sampleCounter - scene->renderOptions.samplesPerPass;
+
+        int numPixels = renderSize.x * renderSize.y;
+        std::vector<float> color(numPixels * 4);
+        std::vector<float> counts;
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, color.data());
+
+        // With adaptive sampling every pixel has its own sample count, which the moments texture keeps
+        if (header.flags & 1)
+        {
+            std::vector<float> moments(numPixels * 2);
+            glBindTexture(GL_TEXTURE_2D, accumMomentsTexture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, moments.data());
+
+            counts.resize(numPixels);
+            for (int i = 0; i < numPixels; i++)
+                counts[i] = moments[i * 2 + 1];
+        }
+
+        if (!WriteAccumulation(filename, header, color.data(), counts.data()))
+            return false;
+
+        printf("Accumulation saved: %s (samples %d to %d)\n", filename.c_str(), header.sampleOffset, header.sampleOffset + header.numSamples - 1);
+        return true;
+    }
+
+    bool Renderer::MergeAccumulations(const std::vector<std::string>& inputs, const std::string& output)
+    {
+        std::string ext = output.substr(output.find_last_of(".") + 1);
+        if (ext != "accum" && !ImageWriter::IsFloatFormat(output))
+        {
+            printf("Merged accumulations are saved as accum, exr, pfm or hdr files\n");
+            return false;
+        }
+
+        AccumulationHeader merged = {};
+        std::vector<AccumulationHeader> headers;
+        std::vector<float> colorSum;
+        std::vector<float> countSum;
+        std::vector<float> data;
+
+        for (const std::string& input : inputs)
+        {
+            FILE* file = fopen(input.c_str(), "rb");
+            if (!file)
+            {
+                printf("Unable to open accumulation %s\n", input.c_str());
+                return false;
+            }
+
+            AccumulationHeader header;
+            if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, kAccumulationMagic, sizeof(header.magic)) || header.version != kAccumulationVersion)
+            {
+                printf("Invalid accumulation %s\n", input.c_str());
+                fclose(file);
+                return false;
+            }
+
+            if (headers.empty())
+            {
+                merged = header;
+                merged.flags = 0;
+                merged.numSamples = 0;
+                colorSum.resize(header.width * header.height * 4, 0.0f);
+                countSum.resize(header.width * header.height, 0.0f);
+            }
+            else if (header.sceneHash != merged.sceneHash || header.width != merged.width || header.height != merged.height)
+            {
+                printf("Accumulation %s was rendered with a different scene or settings\n", input.c_str());
+                fclose(file);
+                return false;
+            }
+
+            // The same sample index gives the same path, so overlapping ranges would count those samples twice
+            for (const AccumulationHeader& other : headers)
+            {
+                if (header.sampleOffset < other.sampleOffset + other.numSamples && other.sampleOffset < header.sampleOffset + header.numSamples)
+                {
+                    printf("Accumulation %s overlaps the sample range of an earlier input\n", input.c_str());
+                    fclose(file);
+                    return false;
+                }
+            }
+
+            int numPixels = header.width * header.height;
+            data.resize(numPixels * 4);
+            bool success = fread(data.data(), sizeof(float), numPixels * 4, file) == numPixels * 4;
+            for (int i = 0; success && i < numPixels * 4; i++)
+                colorSum[i] += data[i];
+
+            if (header.flags & 1)
+            {
+                success = success && fread(data.data(), sizeof(float), numPixels, file) == numPixels;
+                for (int i = 0; success && i < numPixels; i++)
+                    countSum[i] += data[i];
+            }
+            else
+            {
+                for (int i = 0; i < numPixels; i++)
+                    countSum[i] += (float)header.numSamples;
+            }
+
+            fclose(file);
+
+            if (!success)
+            {
+                printf("Accumulation %s is truncated\n", input.c_str());
+                return false;
+            }
+
+            merged.flags |= header.flags;
+            merged.sampleOffset = std::min(merged.sampleOffset, header.sampleOffset);
+            merged.numSamples += header.numSamples;
+            headers.push_back(header);
+        }
+
+        if (headers.empty())
+        {
+            printf("No accumulations to merge\n");
+            return false;
+        }
+
+        printf("Merged %d accumulations (%d samples)\n", (int)headers.size(), merged.numSamples);
+
+        // Merged accumulations can be merged again, e.g. per machine and then per farm
+        if (ext == "accum")
+            return WriteAccumulation(output, merged, colorSum.data(), countSum.data());
+
+        // Each pixel is the sum of all its samples over its total sample count, so every range is weighted by its samples
+        int numPixels = merged.width * merged.height;
+        std::vector<float> pixels(numPixels * 4);
+        for (int i = 0; i < numPixels; i++)
+        {
+            float invCount = countSum[i] > 0.0f ? 1.0f / countSum[i] : 0.0f;
+            for (int j = 0; j < 4; j++)
+                pixels[i * 4 + j] = colorSum[i * 4 + j] * invCount;
+        }
+
+        ImageWriter writer;
+        writer.Write(output, merged.width, merged.height, std::move(pixels));
+        writer.Wait();
+        return true;
+    }
+
+    bool Renderer::IsComplete()
+    {
+        // Rendering stops at maxSpp or full convergence, but the denoise of the final image may still be in flight
+        bool denoising = denoiseRequest != 0 || denoiserFence != 0 || denoiserThread.joinable();
+        return IsFinished() && !(scene->renderOptions.enableDenoiser && denoising);
+    }
+
+    bool Renderer::IsFinished()
+    {
+        // sampleCounter includes the pass being rendered, so the accumulation holds one pass less
+        int numSamples = sampleCounter - scene->renderOptions.samplesPerPass;
+        return !scene->dirty && (converged || (scene->renderOptions.maxSpp != -1 && numSamples >= scene->renderOptions.maxSpp));
+    }
+
+    void Renderer::TonemapOutput(int numSamples)
+    {
+        // Every pixel of accumTexture has numSamples samples at this point
+        tonemapShader->Use();
+        glUniform1f(tonemapShader->GetUniformLocation("invSampleCounter"), 1.0f / numSamples);
+        tonemapShader->StopUsing();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFBO);
+        glViewport(0, 0, renderSize.x, renderSize.y);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        quad->Draw(tonemapShader);
+    }
+
+    void Renderer::UpdateDenoiser()
+    {
+        // Once the readback has landed in the PBO, the frame is handed to the worker thread
+        if (denoiserFence && glClientWaitSync(denoiserFence, 0, 0) != GL_TIMEOUT_EXPIRED)
+        {
+            glDeleteSync(denoiserFence);
+            denoiserFence = 0;
+
+            size_t size = sizeof(float) * renderSize.x * renderSize.y * 10;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, denoiserPBO);
+            void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+            memcpy(denoiserInputPtr, data, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            bool pixelSampleCount = scene->renderOptions.noiseThreshold > 0.0f;
+            float invSamples = 1.0f / denoiseSamples;
+
+            denoiserDone = false;
+            denoiserThread = std::thread([this, pixelSampleCount, invSamples]()
+            {
+                // Turn the accumulated sums into averages. With adaptive sampling each pixel has its own sample count
+                int numPixels = renderSize.x * renderSize.y;
+                float* pixelSamples = denoiserInputPtr + numPixels * 9;
+                for (int i = 0; i < numPixels; i++)
+                {
+                    float scale = pixelSampleCount ? 1.0f / std::max(pixelSamples[i], 1.0f) : invSamples;
+                    for (int j = 0; j < 3; j++)
+                    {
+                        denoiserInputPtr[i * 3 + j] *= scale;
+                        denoiserInputPtr[(numPixels + i) * 3 + j] *= scale;
+                        denoiserInputPtr[(numPixels * 2 + i) * 3 + j] *= scale;
+                    }
+                }
+
+                denoiserFilter.execute();
+
+                // Check for errors
+                const char* errorMessage;
+                if (denoiserDevice.getError(errorMessage) != oidn::Error::None)
+                    std::cout << "Error: " << errorMessage << std::endl;
+
+                denoiserDone = true;
+            });
+        }
+
+        // Tonemap the denoised data into denoisedTexture unless the scene changed in the meantime
+        if (denoiserThread.joinable() && denoiserDone)
+        {
+            denoiserThread.join();
+
+            if (!denoiseStale)
+            {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, denoiserOutputTexture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderSize.x, renderSize.y, GL_RGB, GL_FLOAT, frameOutputPtr);
+
+                tonemapShader->Use();
+                glUniform1f(tonemapShader->GetUniformLocation("invSampleCounter"), 1.0f);
+                glUniform1i(tonemapShader->GetUniformLocation("usePixelSampleCount"), false);
+                tonemapShader->StopUsing();
+
+                glBindFramebuffer(GL_FRAMEBUFFER, denoisedFBO);
+                glViewport(0, 0, renderSize.x, renderSize.y);
+                quad->Draw(tonemapShader);
+
+                tonemapShader->Use();
+                glUniform1i(tonemapShader->GetUniformLocation("usePixelSampleCount"), scene->renderOptions.noiseThreshold > 0.0f);
+                tonemapShader->StopUsing();
+
+                denoised = true;
+            }
+        }
+
+        if (!scene->renderOptions.enableDenoiser)
+        {
+            denoised = false;
+            denoiseRequest = 0;
+            return;
+        }
+
+        bool busy = denoiserFence != 0 || denoiserThread.joinable();
+        if (busy || denoiseRequest == 0)
+            return;
+
+        denoiseSamples = denoiseRequest;
+        denoiseRequest = 0;
+        denoiseFrame = frameCounter;
+        denoiseStale = false;
+
+        // The device and filter persist across denoises and are only recreated on resize
+        if (!denoiserDevice)
+        {
+            denoiserDevice = oidn::newDevice();
+            denoiserDevice.commit();
+        }
+
+        if (!denoiserFilter)
+        {
+            int numPixels = renderSize.x * renderSize.y;
+            denoiserFilter = denoiserDevice.newFilter("RT"); // generic ray tracing filter
+            denoiserFilter.setImage("color", denoiserInputPtr, oidn::Format::Float3, renderSize.x, renderSize.y, 0, 0, 0);
+            denoiserFilter.setImage("albedo", denoiserInputPtr + numPixels * 3, oidn::Format::Float3, renderSize.x, renderSize.y, 0, 0, 0);
+            denoiserFilter.setImage("normal", denoiserInputPtr + numPixels * 6, oidn::Format::Float3, renderSize.x, renderSize.y, 0, 0, 0);
+            denoiserFilter.setImage("output", frameOutputPtr, oidn::Format::Float3, renderSize.x, renderSize.y, 0, 0, 0);
+            denoiserFilter.set("hdr", true);
+            denoiserFilter.commit();
+        }
+
+        // Read back the raw accumulated data, which only has complete passes at this point
+        // FIXME: Figure out a way to have transparency with denoiser
+        size_t imageSize = sizeof(float) * renderSize.x * renderSize.y * 3;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, denoiserPBO);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, 0);
+        glBindTexture(GL_TEXTURE_2D, accumAlbedoTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, (void*)imageSize);
+        glBindTexture(GL_TEXTURE_2D, accumNormalTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, (void*)(imageSize * 2));
+        if (scene->renderOptions.noiseThreshold > 0.0f)
+        {
+            glBindTexture(GL_TEXTURE_2D, accumMomentsTexture);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_GREEN, GL_FLOAT, (void*)(imageSize * 3));
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        denoiserFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void Renderer::WaitForDenoiser()
+    {
+        if (denoiserThread.joinable())
+            denoiserThread.join();
+
+        if (denoiserFence)
+        {
+            glDeleteSync(denoiserFence);
+            denoiserFence = 0;
+        }
+    }
+
+    void Renderer::UpdateTileConvergence()
+    {
+        // Flag converged pixels, then one fragment per tile tests all of its pixels
+        glBindFramebuffer(GL_FRAMEBUFFER, pixelConvergenceFBO);
+        glViewport(0, 0, renderSize.x, renderSize.y);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        quad->Draw(convergenceShader);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, convergenceFBO);
+        glViewport(0, 0, numTiles.x, numTiles.y);
+        quad->Draw(tileConvergenceShader);
+
+        glReadPixels(0, 0, numTiles.x, numTiles.y, GL_RED, GL_UNSIGNED_BYTE, &tileConverged[0]);
+
+        int numConverged = 0;
+        for (unsigned char c : tileConverged)
+            numConverged += c != 0;
+
+        converged = numConverged == (int)tileConverged.size();
+        if (converged)
+            printf("All pixels converged after %d samples\n", sampleCounter - scene->renderOptions.samplesPerPass);
+    }
+
+    void Renderer::InitPathGuide()
+    {
+        // The grid covers the scene bounds with a little padding, so vertices on the boundary don't fall outside
+        Vec3 boundsMin = scene->sceneBounds.pmin;
+        Vec3 boundsMax = scene->sceneBounds.pmax;
+        Vec3 padding = (boundsMax - boundsMin) * 0.01f + Vec3(1e-3f, 1e-3f, 1e-3f);
+        pathGuide = new PathGuide(boundsMin - padding, boundsMax + padding, kGuideGridRes, kGuideDirRes);
+
+        // One row per cell, see PathGuide::BuildCDF
+        glGenTextures(1, &guideTex);
+        glBindTexture(GL_TEXTURE_2D, guideTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, pathGuide->RowSize(), pathGuide->NumCells(), 0, GL_RED, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glActiveTexture(GL_TEXTURE17);
+        glBindTexture(GL_TEXTURE_2D, guideTex);
+        glActiveTexture(GL_TEXTURE0);
+
+        // Create FBO for the training passes. Each recorded vertex of a path writes its position and its direction and weight
+        glGenFramebuffers(1, &guideTrainFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, guideTrainFBO);
+
+        GLenum drawBuffers[6];
+        glGenTextures(6, guideTrainTextures);
+        for (int i = 0; i < kGuideTrainVertices * 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, guideTrainTextures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, kGuideTrainSize, kGuideTrainSize, 0, GL_RGBA, GL_FLOAT, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, guideTrainTextures[i], 0);
+            drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDrawBuffers(kGuideTrainVertices * 2, drawBuffers);
+
+        ResetPathGuide();
+    }
+
+    void Renderer::ResetPathGuide()
+    {
+        pathGuide->Reset();
+        guideIterations = 0;
+
+        std::vector<float> cdf;
+        pathGuide->BuildCDF(cdf);
+        glBindTexture(GL_TEXTURE_2D, guideTex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pathGuide->RowSize(), pathGuide->NumCells(), GL_RED, GL_FLOAT, cdf.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void Renderer::TrainPathGuide()
+    {
+        guideTrainShader->Use();
+        glUniform1i(guideTrainShader->GetUniformLocation("sampleIndex"), kGuideTrainSampleIndex + guideIterations);
+        guideTrainShader->StopUsing();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, guideTrainFBO);
+        glViewport(0, 0, kGuideTrainSize, kGuideTrainSize);
+        quad->Draw(guideTrainShader);
+
+        // The records are read back right away, so the passes after this one are guided by them
+        int numPaths = kGuideTrainSize * kGuideTrainSize;
+        std::vector<float> positions(numPaths * 4);
+        std::vector<float> directions(numPaths * 4);
+        int numRecords = 0;
+
+        for (int i = 0; i < kGuideTrainVertices; i++)
+        {
+            glReadBuffer(GL_COLOR_ATTACHMENT0 + i * 2);
+            glReadPixels(0, 0, kGuideTrainSize, kGuideTrainSize, GL_RGBA, GL_FLOAT, positions.data());
+            glReadBuffer(GL_COLOR_ATTACHMENT0 + i * 2 + 1);
+            glReadPixels(0, 0, kGuideTrainSize, kGuideTrainSize, GL_RGBA, GL_FLOAT, directions.data());
+
+            for (int j = 0; j < numPaths; j++)
+            {
+                // Paths that ended before this vertex leave it empty
+                const float* pos = &positions[j * 4];
+                const float* dir = &directions[j * 4];
+                if (pos[3] == 0.0f || !std::isfinite(dir[3]) || dir[3] < 0.0f)
+                    continue;
+
+                pathGuide->AddRecord(Vec3(pos[0], pos[1], pos[2]), Vec3(dir[0], dir[1], dir[2]), dir[3]);
+                numRecords++;
+            }
+        }
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+        std::vector<float> cdf;
+        pathGuide->BuildCDF(cdf);
+        glBindTexture(GL_TEXTURE_2D, guideTex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pathGuide->RowSize(), pathGuide->NumCells(), GL_RED, GL_FLOAT, cdf.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        guideIterations++;
+        if (guideIterations == kGuideTrainPasses)
+            printf("Path guide trained on %d passes (%d records in the last one)\n", guideIterations, numRecords);
+    }
+
+    void Renderer::UpdateTileBudget()
+    {
+        // Collect finished timer queries without stalling on the ones the GPU is still working on
+        for (int i = 0; i < 2; i++)
+        {
+            if (tileTimerTiles[i] == 0)
+                continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(tileTimerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(tileTimerQueries[i], GL_QUERY_RESULT, &elapsed);
+
+            float tileTime = (float)elapsed * 1e-6f / tileTimerTiles[i];
+            tileTimeEstimate = tileTimeEstimate == 0.0f ? tileTime : tileTimeEstimate * 0.75f + tileTime * 0.25f;
+            tileTimerTiles[i] = 0;
+        }
+
+        int maxTiles = numTiles.x * numTiles.y;
+        if (scene->renderOptions.targetFrameTime <= 0.0f)
+            tilesPerFrame = maxTiles;
+        else if (tileTimeEstimate > 0.0f)
+            tilesPerFrame = std::max(1, std::min(maxTiles, (int)(scene->renderOptions.targetFrameTime / tileTimeEstimate)));
+    }
+
+    void Renderer::UpdatePreviewResolution()
+    {
+        if (!previewTimerPending)
+            return;
+
+        GLint available = 0;
+        glGetQueryObjectiv(previewTimerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(previewTimerQuery, GL_QUERY_RESULT, &elapsed);
+        previewTimerPending = false;
+
+        if (scene->renderOptions.targetFrameTime <= 0.0f)
+            return;
+
+        // Cost scales with the pixel count, so the ratio scales with the square root of the time ratio
+        float previewTime = std::max((float)elapsed * 1e-6f, 0.01f);
+        float ratio = previewTimerRatio * sqrtf(scene->renderOptions.targetFrameTime / previewTime);
+        pixelRatio = Math::Clamp(pixelRatio * 0.5f + ratio * 0.5f, kMinPreviewRatio, kMaxPreviewRatio);
+    }
+
+    bool Renderer::NextTile()
+    {
+        // Steps through the tiles of a pass bottom to top, skipping the ones that have converged.
+        // Returns false once the last tile of the pass has been passed
+        do
+        {
+            tile.x++;
+            if (tile.x >= numTiles.x)
+            {
+                tile.x = 0;
+                tile.y--;
+                if (tile.y < 0)
+                    return false;
+            }
+        } while (tileConverged[tile.y * numTiles.x + tile.x]);
+
+        return true;
+    }
+
     void Renderer::Update(float secondsElapsed)
     {
-        // If maxSpp was reached then stop updates
-        // TODO: Tonemapping and denosing still need to be able to run on final image
-        if (!scene->dirty && scene->renderOptions.maxSpp != -1 && sampleCounter >= scene->renderOptions.maxSpp)
+        UpdateOutputs();
+
+        // If maxSpp was reached or every pixel converged then stop updates. The denoiser still finishes the denoise of the final image
+        // TODO: Tonemapping still needs to be able to run on final image
+        if (IsFinished())
+        {
+            UpdateDenoiser();
             return;
+        }
+
+        UpdatePreviewResolution();
 
         // Update data for instances
         if (scene->instancesModified)
@@ -654,7 +2325,7 @@ namespace GLSLPT
 
             // Update materials
             glBindTexture(GL_TEXTURE_2D, materialsTex);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (sizeof(Material) / sizeof(Vec4)) * scene->materials.size(), 1, 0, GL_RGBA, GL_FLOAT, &scene->materials[0]);
+            UploadMaterials(scene->materials, scene->renderOptions.packMaterials);
 
             // Update top level BVH
             int index = scene->bvhTranslator.topLevelIndex;
@@ -664,6 +2335,10 @@ namespace GLSLPT
             glBufferSubData(GL_TEXTURE_BUFFER, offset, size, &scene->bvhTranslator.nodes[index]);
         }
 
+        // What the guide learned no longer matches the lighting of the scene
+        if (pathGuide && (scene->instancesModified || scene->envMapModified))
+            ResetPathGuide();
+
         // Recreate texture for envmaps
         if (scene->envMapModified)
         {
@@ -688,126 +2363,131 @@ namespace GLSLPT
                 glUniform2f(glGetUniformLocation(shaderObject, "envMapRes"), (float)scene->envMap->width, (float)scene->envMap->height);
                 glUniform1f(glGetUniformLocation(shaderObject, "envMapTotalSum"), scene->envMap->totalSum);
                 pathTraceShaderLowRes->StopUsing();
-            }
-        }
 
-        // Denoise image if requested
-        if (scene->renderOptions.enableDenoiser && sampleCounter > 1)
-        {
-            if (!denoised || (frameCounter % (scene->renderOptions.denoiserFrameCnt * (numTiles.x * numTiles.y)) == 0))
-            {
-                // FIXME: Figure out a way to have transparency with denoiser
-                glBindTexture(GL_TEXTURE_2D, tileOutputTexture[1 - currentBuffer]);
-                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, denoiserInputFramePtr);
-
-                // Create an Intel Open Image Denoise device
-                oidn::DeviceRef device = oidn::newDevice();
-                device.commit();
-
-                // Create a denoising filter
-                oidn::FilterRef filter = device.newFilter("RT"); // generic ray tracing filter
-                filter.setImage("color", denoiserInputFramePtr, oidn::Format::Float3, renderSize.x, renderSize.y, 0, 0, 0);
-                filter.setImage("output", frameOutputPtr, oidn::Format::Float3, renderSize.x, renderSize.y, 0, 0, 0);
-                filter.set("hdr", false);
-                filter.commit();
-
-                // Filter the image
-                filter.execute();
-
-                // Check for errors
-                const char* errorMessage;
-                if (device.getError(errorMessage) != oidn::Error::None)
-                    std::cout << "Error: " << errorMessage << std::endl;
-
-                // Copy the denoised data to denoisedTexture
-                glBindTexture(GL_TEXTURE_2D, denoisedTexture);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, renderSize.x, renderSize.y, 0, GL_RGB, GL_FLOAT, frameOutputPtr);
-
-                denoised = true;
+                if (guideTrainShader)
+                {
+                    guideTrainShader->Use();
+                    shaderObject = guideTrainShader->getObject();
+                    glUniform2f(glGetUniformLocation(shaderObject, "envMapRes"), (float)scene->envMap->width, (float)scene->envMap->height);
+                    glUniform1f(glGetUniformLocation(shaderObject, "envMapTotalSum"), scene->envMap->totalSum);
+                    guideTrainShader->StopUsing();
+                }
             }
         }
-        else
-            denoised = false;
 
         // If scene was modified then clear out image for re-rendering
         if (scene->dirty)
         {
             tile.x = -1;
             tile.y = numTiles.y - 1;
-            sampleCounter = 1;
+            sampleCounter = scene->renderOptions.samplesPerPass;
             denoised = false;
             frameCounter = 1;
+            previewLevel = 0;
+            converged = false;
+            denoiseStale = true;
+            denoiseRequest = 0;
+            std::fill(tileConverged.begin(), tileConverged.end(), 0);
 
-            // Clear out the accumulated texture for rendering a new image
+            // Clear out the accumulated textures for rendering a new image
             glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
             glClear(GL_COLOR_BUFFER_BIT);
+
+            if (scene->renderOptions.noiseThreshold > 0.0f)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, pixelConvergenceFBO);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
         }
-        else // Update render state
+        else if (previewLevel >= kNumPreviewRefineLevels) // Update render state, tiles start once the preview is refined
         {
             frameCounter++;
-            tile.x++;
-            if (tile.x >= numTiles.x)
+            UpdateTileBudget();
+
+            if (!NextTile())
             {
-                tile.x = 0;
-                tile.y--;
-                if (tile.y < 0)
-                {
-                    // If we've reached here, it means all the tiles have been rendered (for a single sample) and the image can now be displayed.
-                    tile.x = 0;
-                    tile.y = numTiles.y - 1;
-                    sampleCounter++;
-                    currentBuffer = 1 - currentBuffer;
-                }
+                // If we've reached here, it means all the tiles have been rendered (for a single sample) and the image can now be displayed.
+                TonemapOutput(sampleCounter);
+                tile.x = -1;
+                tile.y = numTiles.y - 1;
+                sampleCounter += scene->renderOptions.samplesPerPass;
+
+                if (scene->renderOptions.noiseThreshold > 0.0f && sampleCounter > kAdaptiveMinSpp)
+                    UpdateTileConvergence();
+
+                // The accumulation textures only hold complete passes here, so this is when a denoise is requested.
+                // A request for the final image waits for a busy denoiser, any other is dropped as the next pass starts right away
+                bool finished = IsFinished();
+                bool busy = denoiserFence != 0 || denoiserThread.joinable();
+                bool interval = !denoised || frameCounter - denoiseFrame >= scene->renderOptions.denoiserFrameCnt * (numTiles.x * numTiles.y);
+                if (scene->renderOptions.enableDenoiser && (finished || (!busy && interval)))
+                    denoiseRequest = sampleCounter - scene->renderOptions.samplesPerPass;
+
+                // The guide keeps learning over the first passes, the passes after it are guided by what it learned
+                if (guideTrainShader && !finished && guideIterations < kGuideTrainPasses)
+                    TrainPathGuide();
+
+                if (!converged)
+                    NextTile();
             }
         }
 
-        // Update uniforms
+        // Denoise image if requested
+        UpdateDenoiser();
 
-        GLuint shaderObject;
+        // Update uniforms
+        const Camera* camera = scene->camera;
+        const RenderOptions& options = scene->renderOptions;
+
+        FrameUniforms frame;
+        frame.cameraUp = camera->up;
+        frame.cameraRight = camera->right;
+        frame.cameraForward = camera->forward;
+        frame.cameraPosition = camera->position;
+        frame.cameraFov = camera->fov;
+        frame.cameraFocalDist = camera->focalDist;
+        frame.cameraAperture = camera->aperture;
+        frame.uniformLightCol = options.uniformLightCol;
+        frame.envMapIntensity = options.envMapIntensity;
+        frame.envMapRot = options.envMapRot / 360.0f;
+        frame.roughnessMollificationAmt = options.roughnessMollificationAmt;
+        frame.samplesPerPass = options.samplesPerPass;
+        frame.usePixelEstimate = sampleCounter - options.samplesPerPass >= kPixelEstimateMinSpp;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // The rest differs between the programs
         pathTraceShader->Use();
-        shaderObject = pathTraceShader->getObject();
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.position"), scene->camera->position.x, scene->camera->position.y, scene->camera->position.z);
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.right"), scene->camera->right.x, scene->camera->right.y, scene->camera->right.z);
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.up"), scene->camera->up.x, scene->camera->up.y, scene->camera->up.z);
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.forward"), scene->camera->forward.x, scene->camera->forward.y, scene->camera->forward.z);
-        glUniform1f(glGetUniformLocation(shaderObject, "camera.fov"), scene->camera->fov);
-        glUniform1f(glGetUniformLocation(shaderObject, "camera.focalDist"), scene->camera->focalDist);
-        glUniform1f(glGetUniformLocation(shaderObject, "camera.aperture"), scene->camera->aperture);
-        glUniform1i(glGetUniformLocation(shaderObject, "enableEnvMap"), scene->envMap == nullptr ? false : scene->renderOptions.enableEnvMap);
-        glUniform1f(glGetUniformLocation(shaderObject, "envMapIntensity"), scene->renderOptions.envMapIntensity);
-        glUniform1f(glGetUniformLocation(shaderObject, "envMapRot"), scene->renderOptions.envMapRot / 360.0f);
-        glUniform1i(glGetUniformLocation(shaderObject, "maxDepth"), scene->renderOptions.maxDepth);
-        glUniform2f(glGetUniformLocation(shaderObject, "tileOffset"), (float)tile.x * invNumTiles.x, (float)tile.y * invNumTiles.y);
-        glUniform3f(glGetUniformLocation(shaderObject, "uniformLightCol"), scene->renderOptions.uniformLightCol.x, scene->renderOptions.uniformLightCol.y, scene->renderOptions.uniformLightCol.z);
-        glUniform1f(glGetUniformLocation(shaderObject, "roughnessMollificationAmt"), scene->renderOptions.roughnessMollificationAmt);
-        glUniform1i(glGetUniformLocation(shaderObject, "frameNum"), frameCounter);   
+        glUniform1i(pathTraceShader->GetUniformLocation("maxDepth"), options.maxDepth);
+        glUniform2f(pathTraceShader->GetUniformLocation("tileOffset"), (float)tile.x * invNumTiles.x, (float)tile.y * invNumTiles.y);
+        glUniform1i(pathTraceShader->GetUniformLocation("sampleIndex"), options.sampleOffset + sampleCounter - options.samplesPerPass);
         pathTraceShader->StopUsing();
 
+        // The preview traces short paths while the scene changes
         pathTraceShaderLowRes->Use();
-        shaderObject = pathTraceShaderLowRes->getObject();
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.position"), scene->camera->position.x, scene->camera->position.y, scene->camera->position.z);
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.right"), scene->camera->right.x, scene->camera->right.y, scene->camera->right.z);
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.up"), scene->camera->up.x, scene->camera->up.y, scene->camera->up.z);
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.forward"), scene->camera->forward.x, scene->camera->forward.y, scene->camera->forward.z);
-        glUniform1f(glGetUniformLocation(shaderObject, "camera.fov"), scene->camera->fov);
-        glUniform1f(glGetUniformLocation(shaderObject, "camera.focalDist"), scene->camera->focalDist);
-        glUniform1f(glGetUniformLocation(shaderObject, "camera.aperture"), scene->camera->aperture);
-        glUniform1i(glGetUniformLocation(shaderObject, "enableEnvMap"), scene->envMap == nullptr ? false : scene->renderOptions.enableEnvMap);
-        glUniform1f(glGetUniformLocation(shaderObject, "envMapIntensity"), scene->renderOptions.envMapIntensity);
-        glUniform1f(glGetUniformLocation(shaderObject, "envMapRot"), scene->renderOptions.envMapRot / 360.0f);
-        glUniform1i(glGetUniformLocation(shaderObject, "maxDepth"), scene->dirty ? 2 : scene->renderOptions.maxDepth);
-        glUniform3f(glGetUniformLocation(shaderObject, "camera.position"), scene->camera->position.x, scene->camera->position.y, scene->camera->position.z);
-        glUniform3f(glGetUniformLocation(shaderObject, "uniformLightCol"), scene->renderOptions.uniformLightCol.x, scene->renderOptions.uniformLightCol.y, scene->renderOptions.uniformLightCol.z);
-        glUniform1f(glGetUniformLocation(shaderObject, "roughnessMollificationAmt"), scene->renderOptions.roughnessMollificationAmt);
+        glUniform1i(pathTraceShaderLowRes->GetUniformLocation("maxDepth"), scene->dirty ? 2 : options.maxDepth);
         pathTraceShaderLowRes->StopUsing();
 
+        if (guideTrainShader)
+        {
+            guideTrainShader->Use();
+            glUniform1i(guideTrainShader->GetUniformLocation("maxDepth"), options.maxDepth);
+            guideTrainShader->StopUsing();
+        }
+
+        UpdateTonemapUniforms();
+    }
+
+    void Renderer::UpdateTonemapUniforms()
+    {
         tonemapShader->Use();
-        shaderObject = tonemapShader->getObject();
-        glUniform1f(glGetUniformLocation(shaderObject, "invSampleCounter"), 1.0f / (sampleCounter));
-        glUniform1i(glGetUniformLocation(shaderObject, "enableTonemap"), scene->renderOptions.enableTonemap);
-        glUniform1i(glGetUniformLocation(shaderObject, "enableAces"), scene->renderOptions.enableAces);
-        glUniform1i(glGetUniformLocation(shaderObject, "simpleAcesFit"), scene->renderOptions.simpleAcesFit);
-        glUniform3f(glGetUniformLocation(shaderObject, "backgroundCol"), scene->renderOptions.backgroundCol.x, scene->renderOptions.backgroundCol.y, scene->renderOptions.backgroundCol.z);
+        glUniform1i(tonemapShader->GetUniformLocation("usePixelSampleCount"), scene->renderOptions.noiseThreshold > 0.0f);
+        glUniform1i(tonemapShader->GetUniformLocation("enableTonemap"), scene->renderOptions.enableTonemap);
+        glUniform1i(tonemapShader->GetUniformLocation("enableAces"), scene->renderOptions.enableAces);
+        glUniform1i(tonemapShader->GetUniformLocation("simpleAcesFit"), scene->renderOptions.simpleAcesFit);
+        glUniform3f(tonemapShader->GetUniformLocation("backgroundCol"), scene->renderOptions.backgroundCol.x, scene->renderOptions.backgroundCol.y, scene->renderOptions.backgroundCol.z);
         tonemapShader->StopUsing();
     }
 }
\ No newline at end of file
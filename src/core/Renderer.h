@@ -25,14 +25,28 @@
 #pragma once
 
 #include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
 #include "Quad.h"
 #include "Program.h"
 #include "Vec2.h"
 #include "Vec3.h"
+#include "ImageWriter.h"
+#include "PathGuide.h"
+#include "OpenImageDenoise/oidn.hpp"
 
 namespace GLSLPT
 {
-    Program* LoadShaders(const ShaderInclude::ShaderSource& vertShaderObj, const ShaderInclude::ShaderSource& fragShaderObj);
+    Program* LoadShaders(const ShaderInclude::ShaderSource& vertShaderObj, const ShaderInclude::ShaderSource& fragShaderObj, const std::string& cacheDirectory = "");
+
+    // Generator of the random numbers used by the path tracer
+    enum SamplerType
+    {
+        RandomSampler,    // Independent random numbers
+        SobolSampler,     // Owen scrambled Sobol sequence
+        BlueNoiseSampler  // Sobol sequence shifted by screen space blue noise
+    };
 
     struct RenderOptions
     {
@@ -50,7 +64,11 @@ namespace GLSLPT
             texArrayWidth = 2048;
             texArrayHeight = 2048;
             denoiserFrameCnt = 20;
+            samplesPerPass = 1;
+            sampleOffset = 0;
+            sampler = SobolSampler;
             enableRR = true;
+            enableEfficiencyRR = false;
             enableDenoiser = false;
             enableTonemap = true;
             enableAces = false;
@@ -63,6 +81,11 @@ namespace GLSLPT
             independentRenderSize = false;
             enableRoughnessMollification = false;
             enableVolumeMIS = false;
+            enablePathGuiding = false;
+            enableTexCompression = false;
+            packMaterials = true;
+            noiseThreshold = 0.0f;
+            targetFrameTime = 16.0f;
             envMapIntensity = 1.0f;
             envMapRot = 0.0f;
             roughnessMollificationAmt = 0.0f;
@@ -80,7 +103,11 @@ namespace GLSLPT
         int texArrayWidth;
         int texArrayHeight;
         int denoiserFrameCnt;
+        int samplesPerPass; // Paths traced per pixel each time a tile is rendered
+        int sampleOffset; // Index of the first sample, so separate processes can render disjoint sample ranges
+        int sampler; // SamplerType
         bool enableRR;
+        bool enableEfficiencyRR; // Russian roulette and splitting by the expected contribution of a path to its pixel
         bool enableDenoiser;
         bool enableTonemap;
         bool enableAces;
@@ -94,13 +121,27 @@ namespace GLSLPT
         bool independentRenderSize;
         bool enableRoughnessMollification;
         bool enableVolumeMIS;
+        bool enablePathGuiding; // Learn where light comes from and guide surface scattering towards it
+        bool enableTexCompression;
+        bool packMaterials;
         float envMapIntensity;
         float envMapRot;
         float roughnessMollificationAmt;
+        float noiseThreshold; // Adaptive sampling stops at this relative noise level (0 disables it)
+        float targetFrameTime; // GPU time in ms spent on tiles per frame (0 renders a full pass every frame)
     };
 
     class Scene;
 
+    // Output image being read back through a PBO before it is handed to the image writer
+    struct OutputReadback
+    {
+        GLuint pbo;
+        GLsync fence;
+        std::string filename;
+        bool hdr;
+    };
+
     class Renderer
     {
     protected:
@@ -120,28 +161,52 @@ namespace GLSLPT
         GLuint transformsTex;
         GLuint lightsTex;
         GLuint textureMapsArrayTex;
+        GLuint textureMapsRGArrayTex;
+        GLuint textureRectsTex;
         GLuint envMapTex;
         GLuint envMapCDFTex;
+        GLuint blueNoiseTex;
+        GLuint guideTex;
+
+        // Uniform buffer with the per frame state of the path tracing programs
+        GLuint frameUBO;
 
         // FBOs
-        GLuint pathTraceFBO;
         GLuint pathTraceFBOLowRes;
         GLuint accumFBO;
         GLuint outputFBO;
+        GLuint pixelConvergenceFBO;
+        GLuint convergenceFBO;
+        GLuint previewHistoryFBO;
+        GLuint denoisedFBO;
+        GLuint guideTrainFBO;
 
-        // Shaders
+        // Shaders. Sources are expanded once, linked programs are cached on disk when a cache directory is given
         std::string shadersDirectory;
+        std::string shaderCacheDirectory;
+        std::map<std::string, ShaderInclude::ShaderSource> shaderSources;
         Program* pathTraceShader;
         Program* pathTraceShaderLowRes;
         Program* outputShader;
         Program* tonemapShader;
+        Program* convergenceShader;
+        Program* tileConvergenceShader;
+        Program* guideTrainShader;
 
         // Render textures
         GLuint pathTraceTextureLowRes;
-        GLuint pathTraceTexture;
         GLuint accumTexture;
-        GLuint tileOutputTexture[2];
+        GLuint accumMomentsTexture;
+        GLuint accumAlbedoTexture;
+        GLuint accumNormalTexture;
+        GLuint pixelConvergenceTexture;
+        GLuint tileConvergenceTexture;
+        GLuint previewHistoryTexture;
+        GLuint outputTexture;
+        GLuint outputHDRTexture;
+        GLuint denoiserOutputTexture;
         GLuint denoisedTexture;
+        GLuint guideTrainTextures[6];
 
         // Render resolution and window resolution
         iVec2 renderSize;
@@ -153,20 +218,58 @@ namespace GLSLPT
         Vec2 invNumTiles;
         int tileWidth;
         int tileHeight;
-        int currentBuffer;
         int frameCounter;
         int sampleCounter;
         float pixelRatio;
 
+        // Frame time budgeted tile scheduling
+        GLuint tileTimerQueries[2];
+        int tileTimerTiles[2];
+        int tileTimerIndex;
+        float tileTimeEstimate;
+        int tilesPerFrame;
+
+        // Dynamic resolution preview
+        GLuint previewTimerQuery;
+        bool previewTimerPending;
+        float previewTimerRatio;
+        iVec2 previewSize;
+        int previewLevel;
+
+        // Adaptive sampling
+        std::vector<unsigned char> tileConverged;
+        bool converged;
+
+        // Path guiding. The guide is trained on low res passes between the first passes of the render
+        PathGuide* pathGuide;
+        int guideIterations;
+
         // Denoiser output
-        Vec3* denoiserInputFramePtr;
+        float* denoiserInputPtr;
         Vec3* frameOutputPtr;
         bool denoised;
+        int denoiseFrame;
+        int denoiseRequest;
+        int denoiseSamples;
+
+        // Denoiser state. Frames are read back through a PBO and filtered on a worker thread
+        oidn::DeviceRef denoiserDevice;
+        oidn::FilterRef denoiserFilter;
+        GLuint denoiserPBO;
+        GLsync denoiserFence;
+        std::thread denoiserThread;
+        std::atomic<bool> denoiserDone;
+        bool denoiseStale;
+
+        // Saved images are read back through a ring of PBOs and written on the image writer thread
+        OutputReadback outputReadbacks[3];
+        int outputReadbackIndex;
+        ImageWriter imageWriter;
 
         bool initialized;
 
     public:
-        Renderer(Scene* scene, const std::string& shadersDirectory);
+        Renderer(Scene* scene, const std::string& shadersDirectory, const std::string& shaderCacheDirectory = "");
         ~Renderer();
 
         void ResizeRenderer();
@@ -176,11 +279,38 @@ namespace GLSLPT
         void Update(float secondsElapsed);
         float GetProgress();
         int GetSampleCount();
-        void GetOutputBuffer(unsigned char**, int& w, int& h);
+        bool IsComplete();
+        void SaveOutput(const std::string& filename);
+        void FlushOutputs();
+        bool SaveCheckpoint(const std::string& filename);
+        bool LoadCheckpoint(const std::string& filename);
+        bool SaveAccumulation(const std::string& filename);
+        static bool MergeAccumulations(const std::vector<std::string>& inputs, const std::string& output);
 
     private:
         void InitGPUDataBuffers();
         void InitFBOs();
+        void InitDenoiserBuffers();
+        void DeleteDenoiserBuffers();
         void InitShaders();
+        ShaderInclude::ShaderSource GetShaderSource(const std::string& file);
+        void UpdateRenderSizeUniforms();
+        void TonemapOutput(int numSamples);
+        void UpdateTonemapUniforms();
+        void UpdateTileConvergence();
+        void InitPathGuide();
+        void ResetPathGuide();
+        void TrainPathGuide();
+        void UpdateDenoiser();
+        void WaitForDenoiser();
+        void UpdateOutputs();
+        void FinishOutputReadback(OutputReadback& readback);
+        void UpdateTileBudget();
+        void UpdatePreviewResolution();
+        void RenderPreview(float ratio, bool reuseHistory);
+        bool NextTile();
+        bool IsFinished();
+        unsigned long long ComputeSceneHash();
+        unsigned long long ComputeCheckpointHash();
     };
 }
\ No newline at end of file
@@ -26,6 +26,7 @@
 
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include "stb_image_resize.h"
 #include "stb_image.h"
 #include "Scene.h"
@@ -33,6 +34,9 @@
 
 namespace GLSLPT
 {
+    // Border of wrapped texels around each texture in the atlas
+    static const int kTexAtlasPadding = 1;
+
     Scene::~Scene()
     {
         for (int i = 0; i < meshes.size(); i++)
@@ -51,6 +55,8 @@ namespace GLSLPT
 
         if (envMap)
             delete envMap;
+
+        delete snapshot;
     };
 
     void Scene::AddCamera(Vec3 pos, Vec3 lookAt, float fov)
@@ -63,16 +69,27 @@ namespace GLSLPT
     {
         int id = -1;
         // Check if mesh was already loaded
-        for (int i = 0; i < meshes.size(); i++)
-            if (meshes[i]->name == filename)
-                return i;
+        auto it = meshIDs.find(filename);
+        if (it != meshIDs.end())
+            return it->second;
 
         id = meshes.size();
         Mesh* mesh = new Mesh;
 
+        if (deferLoading)
+        {
+            mesh->name = filename;
+            meshes.push_back(mesh);
+            meshIDs[filename] = id;
+            return id;
+        }
+
         printf("Loading model %s\n", filename.c_str());
         if (mesh->LoadFromFile(filename))
+        {
             meshes.push_back(mesh);
+            meshIDs[filename] = id;
+        }
         else
         {
             printf("Unable to load model %s\n", filename.c_str());
@@ -86,16 +103,27 @@ namespace GLSLPT
     {
         int id = -1;
         // Check if texture was already loaded
-        for (int i = 0; i < textures.size(); i++)
-            if (textures[i]->name == filename)
-                return i;
+        auto it = textureIDs.find(filename);
+        if (it != textureIDs.end())
+            return it->second;
 
         id = textures.size();
         Texture* texture = new Texture;
 
+        if (deferLoading)
+        {
+            texture->name = filename;
+            textures.push_back(texture);
+            textureIDs[filename] = id;
+            return id;
+        }
+
         printf("Loading texture %s\n", filename.c_str());
         if (texture->LoadTexture(filename))
+        {
             textures.push_back(texture);
+            textureIDs[filename] = id;
+        }
         else
         {
             printf("Unable to load texture %s\n", filename.c_str());
@@ -153,7 +181,7 @@ namespace GLSLPT
 
         for (int i = 0; i < meshInstances.size(); i++)
         {
-            RadeonRays::bbox bbox = meshes[meshInstances[i].meshID]->bvh->Bounds();
+            RadeonRays::bbox bbox = meshBounds[meshInstances[i].meshID];
             Mat4 matrix = meshInstances[i].transform;
 
             Vec3 minBound = bbox.pmin;
@@ -188,13 +216,310 @@ namespace GLSLPT
 
     void Scene::createBLAS()
     {
-        // Loop through all meshes and build BVHs
+        // Loop through all meshes and build BVHs. A SceneLoader builds them as the meshes are read
 #pragma omp parallel for
         for (int i = 0; i < meshes.size(); i++)
         {
+            if (meshes[i]->bvh->GetNumIndices() > 0)
+                continue;
             printf("Building BVH for %s\n", meshes[i]->name.c_str());
             meshes[i]->BuildBVH();
         }
+
+        meshBounds.resize(meshes.size());
+        for (int i = 0; i < meshes.size(); i++)
+            meshBounds[i] = meshes[i]->bvh->Bounds();
+    }
+
+    void Scene::packTextures()
+    {
+        // Textures are packed at their native size onto atlas pages of texArrayWidth x texArrayHeight
+        // instead of each being resized to fill a whole slice. Only textures larger than a page are downscaled.
+        // Every mip level is packed as a rect of its own so that levels never bleed into neighbouring textures.
+        // The padding holds texels from the opposite edge so bilinear filtering behaves like GL_REPEAT.
+        // Rects are aligned to 4x4 texels so that compressed blocks never straddle two textures
+        struct Shelf
+        {
+            int y, height, cursor;
+        };
+
+        struct Page
+        {
+            std::vector<Shelf> shelves;
+            int nextY;
+        };
+
+        struct Placement
+        {
+            int x, y, page;
+            int width, height;
+            int texID, level;
+            std::vector<unsigned char> data; // Empty if the base level is used as is
+            const unsigned char* pixels;
+        };
+
+        const int pad = kTexAtlasPadding;
+        int pageWidth = renderOptions.texArrayWidth;
+        int pageHeight = renderOptions.texArrayHeight;
+
+        bool compress = renderOptions.enableTexCompression;
+        if (compress && (pageWidth % 4 != 0 || pageHeight % 4 != 0))
+        {
+            printf("Texture array size is not a multiple of 4, texture compression disabled\n");
+            compress = false;
+        }
+
+        // Two channel maps go to their own atlas unless a texture is also used in some other way
+        std::vector<int> mapTypes(textures.size(), -1);
+        auto setMapType = [&mapTypes](float texID, int type)
+        {
+            if (texID < 0)
+                return;
+            int& mapType = mapTypes[(int)texID];
+            mapType = (mapType == -1 || mapType == type) ? type : ColorMap;
+        };
+
+        for (const Material& mat : materials)
+        {
+            setMapType(mat.baseColorTexId, ColorMap);
+            setMapType(mat.metallicRoughnessTexID, MetallicRoughnessMap);
+            setMapType(mat.normalmapTexID, NormalMap);
+            setMapType(mat.emissionmapTexID, ColorMap);
+        }
+
+        for (int& mapType : mapTypes)
+            if (mapType == -1)
+                mapType = ColorMap;
+
+        // Mip chains are appended after the base levels so that a texture ID also indexes its base rect
+        std::vector<std::vector<Placement>> mipChains(textures.size());
+
+#pragma omp parallel for
+        for (int i = 0; i < textures.size(); i++)
+        {
+            int texWidth = textures[i]->width;
+            int texHeight = textures[i]->height;
+            int channels = mapTypes[i] == ColorMap ? 4 : 2;
+
+            // Downscale (preserving aspect) only if the texture doesn't fit on a page
+            float fit = std::min(1.0f, std::min((float)(pageWidth - 2 * pad) / texWidth, (float)(pageHeight - 2 * pad) / texHeight));
+            int width = std::max(1, (int)(texWidth * fit));
+            int height = std::max(1, (int)(texHeight * fit));
+
+            std::vector<Placement>& chain = mipChains[i];
+            chain.resize(1);
+            chain[0].width = width;
+            chain[0].height = height;
+
+            const unsigned char* texData = &textures[i]->texData[0];
+            std::vector<unsigned char> rgData;
+            if (channels == 2)
+            {
+                // Keep only the channels that are read when shading
+                int first = mapTypes[i] == NormalMap ? 0 : 2;
+                int second = 1;
+                rgData.resize(texWidth * texHeight * 2);
+                for (int j = 0; j < texWidth * texHeight; j++)
+                {
+                    rgData[j * 2] = texData[j * 4 + first];
+                    rgData[j * 2 + 1] = texData[j * 4 + second];
+                }
+                texData = &rgData[0];
+            }
+
+            if (width != texWidth || height != texHeight)
+            {
+                chain[0].data.resize(width * height * channels);
+                stbir_resize_uint8(texData, texWidth, texHeight, 0, &chain[0].data[0], width, height, 0, channels);
+            }
+            else if (channels == 2)
+                chain[0].data = std::move(rgData);
+
+            chain[0].pixels = chain[0].data.empty() ? texData : &chain[0].data[0];
+
+            while (width > 1 || height > 1)
+            {
+                width = std::max(1, width / 2);
+                height = std::max(1, height / 2);
+
+                Placement level;
+                level.width = width;
+                level.height = height;
+                level.data.resize(width * height * channels);
+                level.pixels = &level.data[0];
+
+                const Placement& prev = chain.back();
+                stbir_resize_uint8_generic(prev.pixels, prev.width, prev.height, 0, &level.data[0], width, height, 0, channels,
+                    STBIR_ALPHA_CHANNEL_NONE, 0, STBIR_EDGE_WRAP, STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, nullptr);
+
+                chain.push_back(std::move(level));
+            }
+
+            for (int j = 0; j < chain.size(); j++)
+            {
+                chain[j].texID = i;
+                chain[j].level = j;
+            }
+        }
+
+        std::vector<Placement*> placements;
+        for (int i = 0; i < textures.size(); i++)
+            placements.push_back(&mipChains[i][0]);
+        for (int i = 0; i < textures.size(); i++)
+            for (int j = 1; j < mipChains[i].size(); j++)
+                placements.push_back(&mipChains[i][j]);
+
+        // Place the tallest rects first so shelves are filled tightly
+        std::vector<int> order(placements.size());
+        for (int i = 0; i < placements.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&placements](int a, int b) { return placements[a]->height > placements[b]->height; });
+
+        auto allocSize = [pad](int size) { return (size + 2 * pad + 3) & ~3; };
+
+        std::vector<Page> pages[NumTexAtlases];
+        for (int i : order)
+        {
+            Placement& pl = *placements[i];
+            std::vector<Page>& atlasPages = pages[mapTypes[pl.texID] == ColorMap ? ColorAtlas : RGAtlas];
+            int w = allocSize(pl.width);
+            int h = allocSize(pl.height);
+            bool placed = false;
+
+            for (int p = 0; p < atlasPages.size() && !placed; p++)
+            {
+                // First fit into an existing shelf
+                for (Shelf& shelf : atlasPages[p].shelves)
+                {
+                    if (h <= shelf.height && shelf.cursor + w <= pageWidth)
+                    {
+                        pl.x = shelf.cursor;
+                        pl.y = shelf.y;
+                        shelf.cursor += w;
+                        placed = true;
+                        break;
+                    }
+                }
+
+                // Otherwise open a new shelf on this page
+                if (!placed && atlasPages[p].nextY + h <= pageHeight)
+                {
+                    pl.x = 0;
+                    pl.y = atlasPages[p].nextY;
+                    atlasPages[p].shelves.push_back(Shelf{ pl.y, h, w });
+                    atlasPages[p].nextY += h;
+                    placed = true;
+                }
+
+                if (placed)
+                    pl.page = p;
+            }
+
+            if (!placed)
+            {
+                Page page;
+                page.shelves.push_back(Shelf{ 0, h, w });
+                page.nextY = h;
+                atlasPages.push_back(page);
+
+                pl.x = 0;
+                pl.y = 0;
+                pl.page = atlasPages.size() - 1;
+            }
+        }
+
+        int atlasChannels[NumTexAtlases] = { 4, 2 };
+        for (int a = 0; a < NumTexAtlases; a++)
+        {
+            textureAtlases[a].numPages = pages[a].size();
+            textureAtlases[a].format = a == ColorAtlas ? FormatRGBA8 : FormatRG8;
+            textureAtlases[a].data.assign((size_t)pageWidth * pageHeight * atlasChannels[a] * pages[a].size(), 0);
+        }
+
+        textureRects.resize(placements.size());
+
+#pragma omp parallel for
+        for (int i = 0; i < placements.size(); i++)
+        {
+            const Placement& pl = *placements[i];
+            const unsigned char* src = pl.pixels;
+            int mapType = mapTypes[pl.texID];
+            int atlas = mapType == ColorMap ? ColorAtlas : RGAtlas;
+            int channels = atlasChannels[atlas];
+
+            // Wrapped texels fill the padding and the alignment slack
+            unsigned char* page = &textureAtlases[atlas].data[(size_t)pl.page * pageWidth * pageHeight * channels];
+            for (int y = -pad; y < allocSize(pl.height) - pad; y++)
+            {
+                int srcY = (y % pl.height + pl.height) % pl.height;
+                unsigned char* dstRow = page + ((size_t)(pl.y + pad + y) * pageWidth + pl.x + pad) * channels;
+
+                for (int x = -pad; x < allocSize(pl.width) - pad; x++)
+                {
+                    int srcX = (x % pl.width + pl.width) % pl.width;
+                    const unsigned char* texel = src + (srcY * pl.width + srcX) * channels;
+                    std::copy(texel, texel + channels, dstRow + x * channels);
+                }
+            }
+
+            TextureRect& rect = textureRects[i];
+            rect.offset = Vec2((float)(pl.x + pad) / pageWidth, (float)(pl.y + pad) / pageHeight);
+            rect.scale = Vec2((float)pl.width / pageWidth, (float)pl.height / pageHeight);
+            rect.page = pl.page;
+            rect.numLevels = 0;
+            rect.firstMip = 0;
+            rect.mapType = mapType;
+        }
+
+        // Base levels store where their mip chain starts
+        int firstMip = textures.size();
+        for (int i = 0; i < textures.size(); i++)
+        {
+            textureRects[i].numLevels = mipChains[i].size();
+            textureRects[i].firstMip = firstMip;
+            firstMip += mipChains[i].size() - 1;
+        }
+
+        if (compress)
+        {
+            // BC1 unless some color map needs its alpha channel
+            bool hasAlpha = false;
+            for (int i = 0; i < textures.size() && !hasAlpha; i++)
+            {
+                if (mapTypes[i] != ColorMap)
+                    continue;
+                const std::vector<unsigned char>& texData = textures[i]->texData;
+                for (int j = 3; j < texData.size() && !hasAlpha; j += 4)
+                    hasAlpha = texData[j] != 255;
+            }
+
+            TextureFormat formats[NumTexAtlases] = { hasAlpha ? FormatBC3 : FormatBC1, FormatBC5 };
+            for (int a = 0; a < NumTexAtlases; a++)
+            {
+                if (a == ColorAtlas && !colorCompressionSupported)
+                {
+                    printf("S3TC is not supported, color textures are not compressed\n");
+                    continue;
+                }
+
+                TextureAtlas& atlas = textureAtlases[a];
+                size_t srcPageBytes = (size_t)pageWidth * pageHeight * atlasChannels[a];
+                size_t dstPageBytes = TextureDataSize(formats[a], pageWidth, pageHeight);
+
+                std::vector<unsigned char> data(dstPageBytes * atlas.numPages);
+                for (int p = 0; p < atlas.numPages; p++)
+                    CompressTexture(&atlas.data[p * srcPageBytes], pageWidth, pageHeight, formats[a], &data[p * dstPageBytes]);
+
+                atlas.data = std::move(data);
+                atlas.format = formats[a];
+            }
+        }
+
+        const char* formatNames[] = { "RGBA8", "RG8", "BC1", "BC3", "BC5" };
+        printf("Packed %d textures (%d mip levels) into %d color page(s) (%s, %.1f MB) and %d normal/metallic-roughness page(s) (%s, %.1f MB)\n",
+            (int)textures.size(), (int)placements.size(),
+            textureAtlases[ColorAtlas].numPages, formatNames[textureAtlases[ColorAtlas].format], textureAtlases[ColorAtlas].data.size() / (1024.0f * 1024.0f),
+            textureAtlases[RGAtlas].numPages, formatNames[textureAtlases[RGAtlas].format], textureAtlases[RGAtlas].data.size() / (1024.0f * 1024.0f));
     }
 
     void Scene::RebuildInstances()
@@ -213,77 +538,125 @@ namespace GLSLPT
         dirty = true;
     }
 
-    void Scene::ProcessScene()
+    void Scene::UpdateTextures()
     {
-        printf("Processing scene data\n");
-        createBLAS();
+        // Called when the textures were replaced after the scene was processed
+        textureRects.clear();
+        for (int a = 0; a < NumTexAtlases; a++)
+            textureAtlases[a] = TextureAtlas();
 
-        printf("Building scene BVH\n");
-        createTLAS();
+        if (!textures.empty())
+        {
+            printf("Packing textures\n");
+            packTextures();
+        }
+        dirty = true;
+    }
 
-        // Flatten BVH
-        printf("Flattening BVH\n");
-        bvhTranslator.Process(sceneBvh, meshes, meshInstances);
+    BufferView Scene::GetBuffer(SceneBuffer buffer) const
+    {
+        if (snapshot)
+            return snapshot->GetChunk(buffer);
 
-        // Copy mesh data
-        int verticesCnt = 0;
-        printf("Copying Mesh Data\n");
-        for (int i = 0; i < meshes.size(); i++)
+        switch (buffer)
         {
-            // Copy indices from BVH and not from Mesh. 
-            // Required if splitBVH is used as a triangle can be shared by leaf nodes
-            int numIndices = meshes[i]->bvh->GetNumIndices();
-            const int* triIndices = meshes[i]->bvh->GetIndices();
-
-            for (int j = 0; j < numIndices; j++)
-            {
-                int index = triIndices[j];
-                int v1 = (index * 3 + 0) + verticesCnt;
-                int v2 = (index * 3 + 1) + verticesCnt;
-                int v3 = (index * 3 + 2) + verticesCnt;
+        case VertIndicesBuffer:
+            return BufferView{ vertIndices.data(), sizeof(Indices) * vertIndices.size() };
+        case VerticesUVXBuffer:
+            return BufferView{ verticesUVX.data(), sizeof(Vec4) * verticesUVX.size() };
+        case NormalsUVYBuffer:
+            return BufferView{ normalsUVY.data(), sizeof(Vec4) * normalsUVY.size() };
+        case ColorAtlasBuffer:
+            return BufferView{ textureAtlases[ColorAtlas].data.data(), textureAtlases[ColorAtlas].data.size() };
+        case RGAtlasBuffer:
+            return BufferView{ textureAtlases[RGAtlas].data.data(), textureAtlases[RGAtlas].data.size() };
+        default:
+            return BufferView{ nullptr, 0 };
+        }
+    }
 
-                vertIndices.push_back(Indices{ v1, v2, v3 });
-            }
+    void Scene::restoreSnapshot()
+    {
+        // Mesh data and atlases stay in the mapping. The nodes are copied as the top level part
+        // is rebuilt whenever the instances change
+        snapshot->CopyChunk(BvhNodesChunk, bvhTranslator.nodes);
+        snapshot->CopyChunk(MeshBoundsChunk, meshBounds);
+        snapshot->CopyChunk(TextureRectsChunk, textureRects);
+
+        std::vector<int> blasRoots;
+        snapshot->CopyChunk(BlasRootsChunk, blasRoots);
+        bvhTranslator.SetBLASRoots(blasRoots);
+        bvhTranslator.topLevelIndex = snapshot->topLevelIndex;
+
+        for (int a = 0; a < NumTexAtlases; a++)
+        {
+            textureAtlases[a].format = (TextureFormat)snapshot->atlasFormats[a];
+            textureAtlases[a].numPages = snapshot->atlasPages[a];
+        }
+    }
 
-            verticesUVX.insert(verticesUVX.end(), meshes[i]->verticesUVX.begin(), meshes[i]->verticesUVX.end());
-            normalsUVY.insert(normalsUVY.end(), meshes[i]->normalsUVY.begin(), meshes[i]->normalsUVY.end());
+    void Scene::ProcessScene()
+    {
+        if (snapshot)
+        {
+            printf("Restoring scene data from snapshot\n");
+            restoreSnapshot();
 
-            verticesCnt += meshes[i]->verticesUVX.size();
+            createTLAS();
+            bvhTranslator.UpdateTLAS(sceneBvh, meshInstances);
         }
+        else
+        {
+            printf("Processing scene data\n");
+            createBLAS();
 
-        // Copy transforms
-        printf("Copying transforms\n");
-        transforms.resize(meshInstances.size());
-        for (int i = 0; i < meshInstances.size(); i++)
-            transforms[i] = meshInstances[i].transform;
+            printf("Building scene BVH\n");
+            createTLAS();
 
-        // Copy textures
-        if (!textures.empty())
-            printf("Copying and resizing textures\n");
+            // Flatten BVH
+            printf("Flattening BVH\n");
+            bvhTranslator.Process(sceneBvh, meshes, meshInstances);
 
-        int reqWidth = renderOptions.texArrayWidth;
-        int reqHeight = renderOptions.texArrayHeight;
-        int texBytes = reqWidth * reqHeight * 4;
-        textureMapsArray.resize(texBytes * textures.size());
+            // Copy mesh data
+            int verticesCnt = 0;
+            printf("Copying Mesh Data\n");
+            for (int i = 0; i < meshes.size(); i++)
+            {
+                // Copy indices from BVH and not from Mesh. 
+                // Required if splitBVH is used as a triangle can be shared by leaf nodes
+                int numIndices = meshes[i]->bvh->GetNumIndices();
+                const int* triIndices = meshes[i]->bvh->GetIndices();
 
-#pragma omp parallel for
-        for (int i = 0; i < textures.size(); i++)
-        {
-            int texWidth = textures[i]->width;
-            int texHeight = textures[i]->height;
+                for (int j = 0; j < numIndices; j++)
+                {
+                    int index = triIndices[j];
+                    int v1 = (index * 3 + 0) + verticesCnt;
+                    int v2 = (index * 3 + 1) + verticesCnt;
+                    int v3 = (index * 3 + 2) + verticesCnt;
+
+                    vertIndices.push_back(Indices{ v1, v2, v3 });
+                }
+
+                verticesUVX.insert(verticesUVX.end(), meshes[i]->verticesUVX.begin(), meshes[i]->verticesUVX.end());
+                normalsUVY.insert(normalsUVY.end(), meshes[i]->normalsUVY.begin(), meshes[i]->normalsUVY.end());
 
-            // Resize textures to fit 2D texture array
-            if (texWidth != reqWidth || texHeight != reqHeight)
+                verticesCnt += meshes[i]->verticesUVX.size();
+            }
+
+            // Copy textures
+            if (!textures.empty())
             {
-                unsigned char* resizedTex = new unsigned char[texBytes];
-                stbir_resize_uint8(&textures[i]->texData[0], texWidth, texHeight, 0, resizedTex, reqWidth, reqHeight, 0, 4);
-                std::copy(resizedTex, resizedTex + texBytes, &textureMapsArray[i * texBytes]);
-                delete[] resizedTex;
+                printf("Packing textures\n");
+                packTextures();
             }
-            else
-                std::copy(textures[i]->texData.begin(), textures[i]->texData.end(), &textureMapsArray[i * texBytes]);
         }
 
+        // Copy transforms
+        printf("Copying transforms\n");
+        transforms.resize(meshInstances.size());
+        for (int i = 0; i < meshInstances.size(); i++)
+            transforms[i] = meshInstances[i].transform;
+
         // Add a default camera
         if (!camera)
         {
@@ -295,4 +668,4 @@ namespace GLSLPT
 
         initialized = true;
     }
-}
\ No newline at end of file
+}
@@ -27,6 +27,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include "EnvironmentMap.h"
 #include "bvh.h"
 #include "Renderer.h"
@@ -35,6 +36,8 @@
 #include "bvh_translator.h"
 #include "Texture.h"
 #include "Material.h"
+#include "BlockCompression.h"
+#include "SceneSnapshot.h"
 
 namespace GLSLPT
 {
@@ -63,6 +66,40 @@ namespace GLSLPT
         int x, y, z;
     };
 
+    // How a texture is used by the materials. Normal and metallic-roughness maps only need two channels
+    // and are kept in a separate atlas
+    enum TexMapType
+    {
+        ColorMap,
+        NormalMap,           // XY, Z is reconstructed when shading
+        MetallicRoughnessMap // Metallic (B) and roughness (G)
+    };
+
+    enum TexAtlasType
+    {
+        ColorAtlas,
+        RGAtlas,
+        NumTexAtlases
+    };
+
+    // Location of a texture (mip level) within the texture atlas
+    struct TextureRect
+    {
+        Vec2 offset;     // Normalized page coordinates of the first texel
+        Vec2 scale;      // Normalized size of the level on the page
+        float page;
+        float numLevels; // Base level only: length of the mip chain
+        float firstMip;  // Base level only: index of the rect for mip level 1
+        float mapType;
+    };
+
+    struct TextureAtlas
+    {
+        std::vector<unsigned char> data; // Pages of texArrayWidth x texArrayHeight
+        TextureFormat format = FormatRGBA8;
+        int numPages = 0;
+    };
+
     class Scene
     {
     public:
@@ -82,12 +119,18 @@ namespace GLSLPT
 
         void ProcessScene();
         void RebuildInstances();
+        void UpdateTextures();
+
+        // Mesh data and atlas pages for upload, from the mapped snapshot if the scene was restored from one
+        BufferView GetBuffer(SceneBuffer buffer) const;
 
         // Options
         RenderOptions renderOptions;
 
         // Meshes
         std::vector<Mesh*> meshes;
+        std::vector<RadeonRays::bbox> meshBounds;
+        std::unordered_map<std::string, int> meshIDs; // File name to index in meshes, so adding a mesh twice reuses it
 
         // Scene Mesh Data 
         std::vector<Indices> vertIndices;
@@ -116,10 +159,18 @@ namespace GLSLPT
 
         // Texture Data
         std::vector<Texture*> textures;
-        std::vector<unsigned char> textureMapsArray;
+        std::unordered_map<std::string, int> textureIDs; // File name to index in textures
+        TextureAtlas textureAtlases[NumTexAtlases];
+        std::vector<TextureRect> textureRects;
 
         bool initialized;
         bool dirty;
+        // Meshes and textures are only registered when added and are read afterwards by a SceneLoader
+        bool deferLoading = false;
+        // Set by the renderer before the scene is processed. Without S3TC only the normal/metallic-roughness atlas is compressed
+        bool colorCompressionSupported = true;
+        // Set before the scene is processed to restore it from a snapshot instead. Owned by the scene
+        SceneSnapshot* snapshot = nullptr;
         // To check if scene elements need to be resent to GPU
         bool instancesModified = false;
         bool envMapModified = false;
@@ -128,5 +179,7 @@ namespace GLSLPT
         RadeonRays::Bvh* sceneBvh;
         void createBLAS();
         void createTLAS();
+        void packTextures();
+        void restoreSnapshot();
     };
 }
@@ -0,0 +1,218 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdio>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "SceneSnapshot.h"
+#include "Scene.h"
+
+namespace GLSLPT
+{
+    static const char kSnapshotMagic[8] = { 'G', 'L', 'P', 'T', 'S', 'N', 'A', 'P' };
+    static const int kSnapshotVersion = 1;
+
+    // Chunks start at multiples of this, so the mapped data is suitably aligned for any of the element types
+    static const size_t kSnapshotAlignment = 64;
+
+    struct SnapshotHeader
+    {
+        char magic[8];
+        int version;
+        int topLevelIndex;
+        unsigned long long sourceHash;
+        int atlasFormats[NumTexAtlases];
+        int atlasPages[NumTexAtlases];
+        unsigned long long chunkOffsets[NumSnapshotChunks];
+        unsigned long long chunkSizes[NumSnapshotChunks];
+    };
+
+    // Source files are identified by their size and modification time unless their contents are asked for,
+    // which means reading all of them on every launch
+    static unsigned long long HashFile(unsigned long long hash, const std::string& filename, bool contents)
+    {
+        hash = Math::HashBytes(hash, filename.data(), filename.size());
+
+        if (!contents)
+        {
+#ifdef _WIN32
+            struct _stat64 info;
+            if (_stat64(filename.c_str(), &info) != 0)
+                return hash;
+#else
+            struct stat info;
+            if (stat(filename.c_str(), &info) != 0)
+                return hash;
+#endif
+            long long stamp[] = { (long long)info.st_size, (long long)info.st_mtime };
+            return Math::HashBytes(hash, stamp, sizeof(stamp));
+        }
+
+        FILE* file = fopen(filename.c_str(), "rb");
+        if (!file)
+            return hash;
+
+        std::vector<unsigned char> buffer(1 << 20);
+        size_t size;
+        while ((size = fread(buffer.data(), 1, buffer.size(), file)) > 0)
+            hash = Math::HashBytes(hash, buffer.data(), size);
+        fclose(file);
+        return hash;
+    }
+
+    unsigned long long SceneSnapshot::SourceHash(const std::string& sceneFile, const Scene* scene, bool hashContents)
+    {
+        unsigned long long hash = Math::HashSeed;
+        hash = Math::HashBytes(hash, &kSnapshotVersion, sizeof(int));
+
+        // The scene file itself is small and always read in full
+        hash = HashFile(hash, sceneFile, true);
+
+        // Meshes and textures of a GLTF are already read with the scene file, the others are only registered
+        for (const Mesh* mesh : scene->meshes)
+        {
+            if (mesh->verticesUVX.empty())
+                hash = HashFile(hash, mesh->name, hashContents);
+            else
+            {
+                hash = Math::HashBytes(hash, mesh->verticesUVX.data(), sizeof(Vec4) * mesh->verticesUVX.size());
+                hash = Math::HashBytes(hash, mesh->normalsUVY.data(), sizeof(Vec4) * mesh->normalsUVY.size());
+            }
+        }
+
+        for (const Texture* texture : scene->textures)
+        {
+            if (!texture->encodedData.empty())
+                hash = Math::HashBytes(hash, texture->encodedData.data(), texture->encodedData.size());
+            else if (!texture->texData.empty())
+                hash = Math::HashBytes(hash, texture->texData.data(), texture->texData.size());
+            else
+                hash = HashFile(hash, texture->name, hashContents);
+        }
+
+        const RenderOptions& options = scene->renderOptions;
+        int textureOptions[] = { options.texArrayWidth, options.texArrayHeight, options.enableTexCompression };
+        hash = Math::HashBytes(hash, textureOptions, sizeof(textureOptions));
+        return hash;
+    }
+
+    bool SceneSnapshot::Write(const std::string& filename, unsigned long long sourceHash, const Scene* scene)
+    {
+        BufferView chunks[NumSnapshotChunks];
+        for (int i = 0; i < NumSceneBuffers; i++)
+            chunks[i] = scene->GetBuffer((SceneBuffer)i);
+
+        std::vector<int> blasRoots = scene->bvhTranslator.GetBLASRoots();
+        chunks[BvhNodesChunk] = BufferView{ scene->bvhTranslator.nodes.data(), sizeof(RadeonRays::BvhTranslator::Node) * scene->bvhTranslator.nodes.size() };
+        chunks[MeshBoundsChunk] = BufferView{ scene->meshBounds.data(), sizeof(RadeonRays::bbox) * scene->meshBounds.size() };
+        chunks[BlasRootsChunk] = BufferView{ blasRoots.data(), sizeof(int) * blasRoots.size() };
+        chunks[TextureRectsChunk] = BufferView{ scene->textureRects.data(), sizeof(TextureRect) * scene->textureRects.size() };
+
+        SnapshotHeader header;
+        memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+        header.version = kSnapshotVersion;
+        header.topLevelIndex = scene->bvhTranslator.topLevelIndex;
+        header.sourceHash = sourceHash;
+        for (int a = 0; a < NumTexAtlases; a++)
+        {
+            header.atlasFormats[a] = scene->textureAtlases[a].format;
+            header.atlasPages[a] = scene->textureAtlases[a].numPages;
+        }
+
+        size_t offset = (sizeof(SnapshotHeader) + kSnapshotAlignment - 1) & ~(kSnapshotAlignment - 1);
+        for (int i = 0; i < NumSnapshotChunks; i++)
+        {
+            header.chunkOffsets[i] = offset;
+            header.chunkSizes[i] = chunks[i].size;
+            offset = (offset + chunks[i].size + kSnapshotAlignment - 1) & ~(kSnapshotAlignment - 1);
+        }
+
+        // Written under a temporary name, so a snapshot that was cut short is never mapped
+        std::string tempFilename = filename + ".tmp";
+        FILE* file = fopen(tempFilename.c_str(), "wb");
+        if (!file)
+        {
+            printf("Unable to write scene snapshot %s\n", filename.c_str());
+            return false;
+        }
+
+        static const unsigned char padding[kSnapshotAlignment] = {};
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+        size_t position = sizeof(header);
+        for (int i = 0; i < NumSnapshotChunks && written; i++)
+        {
+            written = fwrite(padding, 1, header.chunkOffsets[i] - position, file) == header.chunkOffsets[i] - position;
+            if (written && chunks[i].size > 0)
+                written = fwrite(chunks[i].data, 1, chunks[i].size, file) == chunks[i].size;
+            position = header.chunkOffsets[i] + chunks[i].size;
+        }
+        written = fclose(file) == 0 && written;
+
+        remove(filename.c_str());
+        if (!written || rename(tempFilename.c_str(), filename.c_str()) != 0)
+        {
+            printf("Unable to write scene snapshot %s\n", filename.c_str());
+            remove(tempFilename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    SceneSnapshot* SceneSnapshot::Map(const std::string& filename, unsigned long long sourceHash)
+    {
+        SceneSnapshot* snapshot = new SceneSnapshot;
+        if (!snapshot->file.Open(filename) || snapshot->file.Size() < sizeof(SnapshotHeader))
+        {
+            delete snapshot;
+            return nullptr;
+        }
+
+        size_t size = snapshot->file.Size();
+        const SnapshotHeader& header = *(const SnapshotHeader*)snapshot->file.Data();
+        bool valid = memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) == 0 && header.version == kSnapshotVersion && header.sourceHash == sourceHash;
+        for (int i = 0; i < NumSnapshotChunks && valid; i++)
+            valid = header.chunkOffsets[i] <= size && header.chunkSizes[i] <= size - header.chunkOffsets[i];
+
+        if (!valid)
+        {
+            delete snapshot;
+            return nullptr;
+        }
+
+        snapshot->topLevelIndex = header.topLevelIndex;
+        for (int a = 0; a < NumTexAtlases; a++)
+        {
+            snapshot->atlasFormats[a] = header.atlasFormats[a];
+            snapshot->atlasPages[a] = header.atlasPages[a];
+        }
+        memcpy(snapshot->chunkOffsets, header.chunkOffsets, sizeof(header.chunkOffsets));
+        memcpy(snapshot->chunkSizes, header.chunkSizes, sizeof(header.chunkSizes));
+        return snapshot;
+    }
+
+    BufferView SceneSnapshot::GetChunk(int chunk) const
+    {
+        return BufferView{ file.Data() + chunkOffsets[chunk], (size_t)chunkSizes[chunk] };
+    }
+}
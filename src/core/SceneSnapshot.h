@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include "MappedFile.h"
+
+namespace GLSLPT
+{
+    class Scene;
+
+    // Contiguous scene data as it is uploaded to the GPU
+    struct BufferView
+    {
+        const void* data;
+        size_t size;
+    };
+
+    // The buffers a scene can be rendered from without them being held in its vectors
+    enum SceneBuffer
+    {
+        VertIndicesBuffer,
+        VerticesUVXBuffer,
+        NormalsUVYBuffer,
+        ColorAtlasBuffer,
+        RGAtlasBuffer,
+        NumSceneBuffers
+    };
+
+    enum SnapshotChunk
+    {
+        // The scene buffers come first, in the order above
+        BvhNodesChunk = NumSceneBuffers,
+        MeshBoundsChunk,
+        BlasRootsChunk,
+        TextureRectsChunk,
+        NumSnapshotChunks
+    };
+
+    // A processed scene (flattened BVH, mesh data and packed texture atlases) written to a file and mapped into
+    // memory when the scene is opened again, so the meshes and textures don't have to be read and processed.
+    // A snapshot is only used if it was made from the same scene, mesh and texture files
+    class SceneSnapshot
+    {
+    public:
+        // Hash of everything the processed data is derived from. Mesh and texture files are only told apart by
+        // their size and modification time unless hashContents is set
+        static unsigned long long SourceHash(const std::string& sceneFile, const Scene* scene, bool hashContents = false);
+
+        static bool Write(const std::string& filename, unsigned long long sourceHash, const Scene* scene);
+
+        // Returns nullptr if there's no valid snapshot for the sources
+        static SceneSnapshot* Map(const std::string& filename, unsigned long long sourceHash);
+
+        BufferView GetChunk(int chunk) const;
+
+        template <typename T>
+        void CopyChunk(int chunk, std::vector<T>& out) const
+        {
+            BufferView view = GetChunk(chunk);
+            out.resize(view.size / sizeof(T));
+            if (!out.empty())
+                memcpy(out.data(), view.data, out.size() * sizeof(T));
+        }
+
+        int topLevelIndex;
+        int atlasFormats[2]; // Color and RG atlas
+        int atlasPages[2];
+
+    private:
+        SceneSnapshot() = default;
+
+        MappedFile file;
+        unsigned long long chunkOffsets[NumSnapshotChunks];
+        unsigned long long chunkSizes[NumSnapshotChunks];
+    };
+}
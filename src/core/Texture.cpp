@@ -49,4 +49,16 @@ namespace GLSLPT
         stbi_image_free(data);
         return true;
     }
-}
\ No newline at end of file
+
+    bool Texture::LoadTexture(const unsigned char* fileData, int size)
+    {
+        components = 4;
+        unsigned char* data = stbi_load_from_memory(fileData, size, &width, &height, NULL, components);
+        if (data == nullptr)
+            return false;
+        texData.resize(width * height * components);
+        std::copy(data, data + width * height * components, texData.begin());
+        stbi_image_free(data);
+        return true;
+    }
+}
@@ -37,11 +37,13 @@ namespace GLSLPT
         ~Texture() { }
 
         bool LoadTexture(const std::string& filename);
+        bool LoadTexture(const unsigned char* fileData, int size);
 
         int width;
         int height;
         int components;
         std::vector<unsigned char> texData;
+        std::vector<unsigned char> encodedData; // Image file contents (e.g. embedded in a GLTF) that are yet to be decoded
         std::string name;
     };
 }
@@ -225,11 +225,30 @@ namespace GLSLPT
             std::string texName = gltfTex.name;
             if (strcmp(gltfTex.name.c_str(), "") == 0)
                 texName = image.uri;
-            Texture* texture = new Texture(texName, image.image.data(), image.width, image.height, image.component);
+
+            Texture* texture;
+            if (image.as_is)
+            {
+                // Decoded later by a SceneLoader
+                texture = new Texture;
+                texture->name = texName;
+                texture->encodedData = image.image;
+            }
+            else
+                texture = new Texture(texName, image.image.data(), image.width, image.height, image.component);
             scene->textures.push_back(texture);
         }
     }
 
+    // Keeps the encoded image so that it can be decoded on a worker thread instead of while parsing
+    bool StoreImageData(tinygltf::Image* image, const int /*imageIdx*/, std::string* /*err*/, std::string* /*warn*/,
+        int /*reqWidth*/, int /*reqHeight*/, const unsigned char* bytes, int size, void* /*userData*/)
+    {
+        image->image.assign(bytes, bytes + size);
+        image->as_is = true;
+        return true;
+    }
+
     void LoadMaterials(Scene* scene, tinygltf::Model& gltfModel)
     {
         int sceneTexIdx = scene->textures.size();
@@ -390,6 +409,9 @@ namespace GLSLPT
 
         bool ret;
 
+        if (scene->deferLoading)
+            loader.SetImageLoader(StoreImageData, nullptr);
+
         if (binary)
             ret = loader.LoadBinaryFromFile(&gltfModel, &err, &warn, filename);
         else
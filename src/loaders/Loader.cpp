@@ -25,493 +25,647 @@ freely, subject to the following restrictions:
     Link to original code: https://github.com/mmacklin/tinsel
 */
 
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
+#include <unordered_map>
+#include <vector>
 #include "Loader.h"
 #include "GLTFLoader.h"
 
 namespace GLSLPT
 {
-    static const int kMaxLineLength = 2048;
-
-    bool LoadSceneFromFile(const std::string& filename, Scene* scene, RenderOptions& renderOptions)
+    // Splits the scene file into lines and tokens in a single pass. Works in place on a NUL terminated copy of the file:
+    // lines and tokens are terminated where they end so they can be compared and converted without copying
+    class SceneTokenizer
     {
-        FILE* file;
-        file = fopen(filename.c_str(), "r");
+    public:
+        SceneTokenizer(char* text) : next(text), cur(text) {}
 
-        if (!file)
+        // Moves to the next line, returns false at the end of the file
+        bool NextLine()
         {
-            printf("Couldn't open %s for reading\n", filename.c_str());
-            return false;
+            if (*next == '\0')
+                return false;
+
+            cur = next;
+            char* eol = strchr(next, '\n');
+            if (eol)
+            {
+                *eol = '\0';
+                next = eol + 1;
+            }
+            else
+                next = cur + strlen(cur);
+
+            return true;
         }
 
-        printf("Loading Scene..\n");
+        // Moves to the next line of a { } block, returns false once the line closing the block has been read
+        bool NextBlockLine()
+        {
+            return NextLine() && !strchr(cur, '}');
+        }
 
-        struct MaterialData
+        // Next token of the current line or an empty string if there are none left. Braces separate tokens
+        // so "mesh{" reads the same as "mesh {"
+        const char* Token()
         {
-            Material mat;
-            int id;
-        };
-
-        std::map<std::string, MaterialData> materialMap;
-        std::vector<std::string> albedoTex;
-        std::vector<std::string> metallicRoughnessTex;
-        std::vector<std::string> normalTex;
-        std::string path = filename.substr(0, filename.find_last_of("/\\")) + "/";
+            while (*cur != '\0' && IsSeparator(*cur))
+                cur++;
 
-        int materialCount = 0;
-        char line[kMaxLineLength];
+            const char* token = cur;
+            while (*cur != '\0' && !IsSeparator(*cur))
+                cur++;
 
-        //Defaults
-        Material defaultMat;
-        scene->AddMaterial(defaultMat);
+            if (*cur != '\0')
+                *cur++ = '\0';
 
-        while (fgets(line, kMaxLineLength, file))
+            return token;
+        }
+
+        // Remainder of the current line up to a tab, for names containing spaces
+        std::string Rest()
         {
-            // skip comments
-            if (line[0] == '#')
-                continue;
+            while (*cur != '\0' && isspace((unsigned char)*cur))
+                cur++;
 
-            // name used for materials and meshes
-            char name[kMaxLineLength] = { 0 };
+            size_t length = strcspn(cur, "\t\r");
+            std::string rest(cur, length);
+            cur += length;
+            return rest;
+        }
 
-            //--------------------------------------------
-            // Material
+        // Values are only written when they parse, and reading stops at the first one that doesn't
+        bool Read(float& value)
+        {
+            const char* token = Token();
+            char* end;
+            float f = strtof(token, &end);
+            if (end == token)
+                return false;
+            value = f;
+            return true;
+        }
 
-            if (sscanf(line, " material %s", name) == 1)
-            {
-                Material material;
-                char albedoTexName[100] = "none";
-                char metallicRoughnessTexName[100] = "none";
-                char normalTexName[100] = "none";
-                char emissionTexName[100] = "none";
-                char alphaMode[20] = "none";
-                char mediumType[20] = "none";
-
-                while (fgets(line, kMaxLineLength, file))
-                {
-                    // end group
-                    if (strchr(line, '}'))
-                        break;
-
-                    sscanf(line, " color %f %f %f", &material.baseColor.x, &material.baseColor.y, &material.baseColor.z);
-                    sscanf(line, " opacity %f", &material.opacity);
-                    sscanf(line, " alphamode %s", alphaMode);
-                    sscanf(line, " alphacutoff %f", &material.alphaCutoff);
-                    sscanf(line, " emission %f %f %f", &material.emission.x, &material.emission.y, &material.emission.z);
-                    sscanf(line, " metallic %f", &material.metallic);
-                    sscanf(line, " roughness %f", &material.roughness);
-                    sscanf(line, " subsurface %f", &material.subsurface);
-                    sscanf(line, " speculartint %f", &material.specularTint);
-                    sscanf(line, " anisotropic %f", &material.anisotropic);
-                    sscanf(line, " sheen %f", &material.sheen);
-                    sscanf(line, " sheentint %f", &material.sheenTint);
-                    sscanf(line, " clearcoat %f", &material.clearcoat);
-                    sscanf(line, " clearcoatgloss %f", &material.clearcoatGloss);
-                    sscanf(line, " spectrans %f", &material.specTrans);
-                    sscanf(line, " ior %f", &material.ior);
-                    sscanf(line, " albedotexture %s", albedoTexName);
-                    sscanf(line, " metallicroughnesstexture %s", metallicRoughnessTexName);
-                    sscanf(line, " normaltexture %s", normalTexName);
-                    sscanf(line, " emissiontexture %s", emissionTexName);
-                    sscanf(line, " mediumtype %s", mediumType);
-                    sscanf(line, " mediumdensity %f", &material.mediumDensity);
-                    sscanf(line, " mediumcolor %f %f %f", &material.mediumColor.x, &material.mediumColor.y, &material.mediumColor.z);
-                    sscanf(line, " mediumanisotropy %f", &material.mediumAnisotropy);
-                }
+        bool Read(int& value)
+        {
+            const char* token = Token();
+            char* end;
+            long i = strtol(token, &end, 10);
+            if (end == token)
+                return false;
+            value = (int)i;
+            return true;
+        }
 
-                // Albedo Texture
-                if (strcmp(albedoTexName, "none") != 0)
-                    material.baseColorTexId = scene->AddTexture(path + albedoTexName);
-
-                // MetallicRoughness Texture
-                if (strcmp(metallicRoughnessTexName, "none") != 0)
-                    material.metallicRoughnessTexID = scene->AddTexture(path + metallicRoughnessTexName);
-
-                // Normal Map Texture
-                if (strcmp(normalTexName, "none") != 0)
-                    material.normalmapTexID = scene->AddTexture(path + normalTexName);
-
-                // Emission Map Texture
-                if (strcmp(emissionTexName, "none") != 0)
-                    material.emissionmapTexID = scene->AddTexture(path + emissionTexName);
-
-                // AlphaMode
-                if (strcmp(alphaMode, "opaque") == 0)
-                    material.alphaMode = AlphaMode::Opaque;
-                else if (strcmp(alphaMode, "blend") == 0)
-                    material.alphaMode = AlphaMode::Blend;
-                else if (strcmp(alphaMode, "mask") == 0)
-                    material.alphaMode = AlphaMode::Mask;
-
-                // MediumType
-                if (strcmp(mediumType, "absorb") == 0)
-                    material.mediumType = MediumType::Absorb;
-                else if (strcmp(mediumType, "scatter") == 0)
-                    material.mediumType = MediumType::Scatter;
-                else if (strcmp(mediumType, "emissive") == 0)
-                    material.mediumType = MediumType::Emissive;
-
-                // add material to map
-                if (materialMap.find(name) == materialMap.end()) // New material
-                {
-                    int id = scene->AddMaterial(material);
-                    materialMap[name] = MaterialData{ material, id };
-                }
-            }
+        bool Read(std::string& value)
+        {
+            const char* token = Token();
+            if (*token == '\0')
+                return false;
+            value = token;
+            return true;
+        }
 
-            //--------------------------------------------
-            // Light
+        bool Read(bool& value)
+        {
+            const char* token = Token();
+            if (strcmp(token, "true") == 0)
+                value = true;
+            else if (strcmp(token, "false") == 0)
+                value = false;
+            else
+                return false;
+            return true;
+        }
+
+        bool Read(Vec3& value)
+        {
+            return Read(value.x) && Read(value.y) && Read(value.z);
+        }
 
-            if (strstr(line, "light"))
+        bool Read(iVec2& value)
+        {
+            return Read(value.x) && Read(value.y);
+        }
+
+        // Row-major in the file. True if any of the values were read
+        bool Read(Mat4& value)
+        {
+            int count = 0;
+            for (int i = 0; i < 16; i++)
             {
-                Light light;
-                Vec3 v1, v2;
-                char lightType[20] = "none";
+                if (!Read(value[i % 4][i / 4]))
+                    break;
+                count++;
+            }
+            return count > 0;
+        }
 
-                while (fgets(line, kMaxLineLength, file))
-                {
-                    // end group
-                    if (strchr(line, '}'))
-                        break;
+    private:
+        static bool IsSeparator(char c)
+        {
+            return isspace((unsigned char)c) || c == '{' || c == '}';
+        }
 
-                    sscanf(line, " position %f %f %f", &light.position.x, &light.position.y, &light.position.z);
-                    sscanf(line, " emission %f %f %f", &light.emission.x, &light.emission.y, &light.emission.z);
+        char* next;
+        char* cur;
+    };
 
-                    sscanf(line, " radius %f", &light.radius);
-                    sscanf(line, " v1 %f %f %f", &v1.x, &v1.y, &v1.z);
-                    sscanf(line, " v2 %f %f %f", &v2.x, &v2.y, &v2.z);
-                    sscanf(line, " type %s", lightType);
-                }
+    static bool ReadFile(const std::string& filename, std::vector<char>& text)
+    {
+        FILE* file = fopen(filename.c_str(), "rb");
+        if (!file)
+            return false;
 
-                if (strcmp(lightType, "quad") == 0)
-                {
-                    light.type = LightType::RectLight;
-                    light.u = v1 - light.position;
-                    light.v = v2 - light.position;
-                    light.area = Vec3::Length(Vec3::Cross(light.u, light.v));
-                }
-                else if (strcmp(lightType, "sphere") == 0)
-                {
-                    light.type = LightType::SphereLight;
-                    light.area = 4.0f * PI * light.radius * light.radius;
-                }
-                else if (strcmp(lightType, "distant") == 0)
-                {
-                    light.type = LightType::DistantLight;
-                    light.area = 0.0f;
-                }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
 
-                scene->AddLight(light);
-            }
+        text.resize(size + 1);
+        size_t read = fread(text.data(), 1, size, file);
+        text[read] = '\0';
+        fclose(file);
 
-            //--------------------------------------------
-            // Camera
+        return true;
+    }
 
-            if (strstr(line, "camera"))
-            {
-                Mat4 xform;
-                Vec3 position;
-                Vec3 lookAt;
-                float fov;
-                float aperture = 0, focalDist = 1;
-                bool matrixProvided = false;
-
-                while (fgets(line, kMaxLineLength, file))
-                {
-                    // end group
-                    if (strchr(line, '}'))
-                        break;
-
-                    sscanf(line, " position %f %f %f", &position.x, &position.y, &position.z);
-                    sscanf(line, " lookat %f %f %f", &lookAt.x, &lookAt.y, &lookAt.z);
-                    sscanf(line, " aperture %f ", &aperture);
-                    sscanf(line, " focaldist %f", &focalDist);
-                    sscanf(line, " fov %f", &fov);
-
-                    if (sscanf(line, " matrix %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
-                        &xform[0][0], &xform[1][0], &xform[2][0], &xform[3][0],
-                        &xform[0][1], &xform[1][1], &xform[2][1], &xform[3][1],
-                        &xform[0][2], &xform[1][2], &xform[2][2], &xform[3][2],
-                        &xform[0][3], &xform[1][3], &xform[2][3], &xform[3][3]
-                    ) != 0)
-                        matrixProvided = true;
-                }
+    static void LoadMaterial(SceneTokenizer& tokens, Scene* scene, const std::string& path, const std::string& name, std::unordered_map<std::string, int>& materialIDs)
+    {
+        Material material;
+        std::string albedoTexName = "none";
+        std::string metallicRoughnessTexName = "none";
+        std::string normalTexName = "none";
+        std::string emissionTexName = "none";
+        std::string alphaMode = "none";
+        std::string mediumType = "none";
+
+        while (tokens.NextBlockLine())
+        {
+            const char* key = tokens.Token();
+
+            if (strcmp(key, "color") == 0)
+                tokens.Read(material.baseColor);
+            else if (strcmp(key, "opacity") == 0)
+                tokens.Read(material.opacity);
+            else if (strcmp(key, "alphamode") == 0)
+                tokens.Read(alphaMode);
+            else if (strcmp(key, "alphacutoff") == 0)
+                tokens.Read(material.alphaCutoff);
+            else if (strcmp(key, "emission") == 0)
+                tokens.Read(material.emission);
+            else if (strcmp(key, "metallic") == 0)
+                tokens.Read(material.metallic);
+            else if (strcmp(key, "roughness") == 0)
+                tokens.Read(material.roughness);
+            else if (strcmp(key, "subsurface") == 0)
+                tokens.Read(material.subsurface);
+            else if (strcmp(key, "speculartint") == 0)
+                tokens.Read(material.specularTint);
+            else if (strcmp(key, "anisotropic") == 0)
+                tokens.Read(material.anisotropic);
+            else if (strcmp(key, "sheen") == 0)
+                tokens.Read(material.sheen);
+            else if (strcmp(key, "sheentint") == 0)
+                tokens.Read(material.sheenTint);
+            else if (strcmp(key, "clearcoat") == 0)
+                tokens.Read(material.clearcoat);
+            else if (strcmp(key, "clearcoatgloss") == 0)
+                tokens.Read(material.clearcoatGloss);
+            else if (strcmp(key, "spectrans") == 0)
+                tokens.Read(material.specTrans);
+            else if (strcmp(key, "ior") == 0)
+                tokens.Read(material.ior);
+            else if (strcmp(key, "albedotexture") == 0)
+                tokens.Read(albedoTexName);
+            else if (strcmp(key, "metallicroughnesstexture") == 0)
+                tokens.Read(metallicRoughnessTexName);
+            else if (strcmp(key, "normaltexture") == 0)
+                tokens.Read(normalTexName);
+            else if (strcmp(key, "emissiontexture") == 0)
+                tokens.Read(emissionTexName);
+            else if (strcmp(key, "mediumtype") == 0)
+                tokens.Read(mediumType);
+            else if (strcmp(key, "mediumdensity") == 0)
+                tokens.Read(material.mediumDensity);
+            else if (strcmp(key, "mediumcolor") == 0)
+                tokens.Read(material.mediumColor);
+            else if (strcmp(key, "mediumanisotropy") == 0)
+                tokens.Read(material.mediumAnisotropy);
+        }
 
-                delete scene->camera;
+        // Albedo Texture
+        if (albedoTexName != "none")
+            material.baseColorTexId = scene->AddTexture(path + albedoTexName);
+
+        // MetallicRoughness Texture
+        if (metallicRoughnessTexName != "none")
+            material.metallicRoughnessTexID = scene->AddTexture(path + metallicRoughnessTexName);
+
+        // Normal Map Texture
+        if (normalTexName != "none")
+            material.normalmapTexID = scene->AddTexture(path + normalTexName);
+
+        // Emission Map Texture
+        if (emissionTexName != "none")
+            material.emissionmapTexID = scene->AddTexture(path + emissionTexName);
+
+        // AlphaMode
+        if (alphaMode == "opaque")
+            material.alphaMode = AlphaMode::Opaque;
+        else if (alphaMode == "blend")
+            material.alphaMode = AlphaMode::Blend;
+        else if (alphaMode == "mask")
+            material.alphaMode = AlphaMode::Mask;
+
+        // MediumType
+        if (mediumType == "absorb")
+            material.mediumType = MediumType::Absorb;
+        else if (mediumType == "scatter")
+            material.mediumType = MediumType::Scatter;
+        else if (mediumType == "emissive")
+            material.mediumType = MediumType::Emissive;
+
+        // add material to map
+        if (materialIDs.find(name) == materialIDs.end()) // New material
+            materialIDs[name] = scene->AddMaterial(material);
+    }
 
-                if (matrixProvided)
-                {
-                    Vec3 forward = Vec3(xform[2][0], xform[2][1], xform[2][2]);
-                    position = Vec3(xform[3][0], xform[3][1], xform[3][2]);
-                    lookAt = position + forward;
-                }
+    static void LoadLight(SceneTokenizer& tokens, Scene* scene)
+    {
+        Light light;
+        Vec3 v1, v2;
+        std::string lightType = "none";
 
-                scene->AddCamera(position, lookAt, fov);
-                scene->camera->aperture = aperture;
-                scene->camera->focalDist = focalDist;
-            }
+        while (tokens.NextBlockLine())
+        {
+            const char* key = tokens.Token();
+
+            if (strcmp(key, "position") == 0)
+                tokens.Read(light.position);
+            else if (strcmp(key, "emission") == 0)
+                tokens.Read(light.emission);
+            else if (strcmp(key, "radius") == 0)
+                tokens.Read(light.radius);
+            else if (strcmp(key, "v1") == 0)
+                tokens.Read(v1);
+            else if (strcmp(key, "v2") == 0)
+                tokens.Read(v2);
+            else if (strcmp(key, "type") == 0)
+                tokens.Read(lightType);
+        }
 
-            //--------------------------------------------
-            // Renderer
+        if (lightType == "quad")
+        {
+            light.type = LightType::RectLight;
+            light.u = v1 - light.position;
+            light.v = v2 - light.position;
+            light.area = Vec3::Length(Vec3::Cross(light.u, light.v));
+        }
+        else if (lightType == "sphere")
+        {
+            light.type = LightType::SphereLight;
+            light.area = 4.0f * PI * light.radius * light.radius;
+        }
+        else if (lightType == "distant")
+        {
+            light.type = LightType::DistantLight;
+            light.area = 0.0f;
+        }
 
-            if (strstr(line, "renderer"))
-            {
-                char envMap[200] = "none";
-                char enableRR[10] = "none";
-                char enableAces[10] = "none";
-                char openglNormalMap[10] = "none";
-                char hideEmitters[10] = "none";
-                char transparentBackground[10] = "none";
-                char enableBackground[10] = "none";
-                char independentRenderSize[10] = "none";
-                char enableTonemap[10] = "none";
-                char enableRoughnessMollification[10] = "none";
-                char enableVolumeMIS[10] = "none";
-                char enableUniformLight[10] = "none";
-
-                while (fgets(line, kMaxLineLength, file))
-                {
-                    // end group
-                    if (strchr(line, '}'))
-                        break;
-
-                    sscanf(line, " envmapfile %s", envMap);
-                    sscanf(line, " resolution %d %d", &renderOptions.renderResolution.x, &renderOptions.renderResolution.y);
-                    sscanf(line, " windowresolution %d %d", &renderOptions.windowResolution.x, &renderOptions.windowResolution.y);
-                    sscanf(line, " envmapintensity %f", &renderOptions.envMapIntensity);
-                    sscanf(line, " maxdepth %i", &renderOptions.maxDepth);
-                    sscanf(line, " maxspp %i", &renderOptions.maxSpp);
-                    sscanf(line, " tilewidth %i", &renderOptions.tileWidth);
-                    sscanf(line, " tileheight %i", &renderOptions.tileHeight);
-                    sscanf(line, " enablerr %s", enableRR);
-                    sscanf(line, " rrdepth %i", &renderOptions.RRDepth);
-                    sscanf(line, " enabletonemap %s", enableTonemap);
-                    sscanf(line, " enableaces %s", enableAces);
-                    sscanf(line, " texarraywidth %i", &renderOptions.texArrayWidth);
-                    sscanf(line, " texarrayheight %i", &renderOptions.texArrayHeight);
-                    sscanf(line, " openglnormalmap %s", openglNormalMap);
-                    sscanf(line, " hideemitters %s", hideEmitters);
-                    sscanf(line, " enablebackground %s", enableBackground);
-                    sscanf(line, " transparentbackground %s", transparentBackground);
-                    sscanf(line, " backgroundcolor %f %f %f", &renderOptions.backgroundCol.x, &renderOptions.backgroundCol.y, &renderOptions.backgroundCol.z);
-                    sscanf(line, " independentrendersize %s", independentRenderSize);
-                    sscanf(line, " envmaprotation %f", &renderOptions.envMapRot);
-                    sscanf(line, " enableroughnessmollification %s", enableRoughnessMollification);
-                    sscanf(line, " roughnessmollificationamt %f", &renderOptions.roughnessMollificationAmt);
-                    sscanf(line, " enablevolumemis %s", enableVolumeMIS);
-                    sscanf(line, " enableuniformlight %s", enableUniformLight);
-                    sscanf(line, " uniformlightcolor %f %f %f", &renderOptions.uniformLightCol.x, &renderOptions.uniformLightCol.y, &renderOptions.uniformLightCol.z);
-                }
+        scene->AddLight(light);
+    }
 
-                if (strcmp(envMap, "none") != 0)
+    static void LoadCamera(SceneTokenizer& tokens, Scene* scene)
+    {
+        Mat4 xform;
+        Vec3 position;
+        Vec3 lookAt;
+        float fov = 45.0f;
+        float aperture = 0, focalDist = 1;
+        bool matrixProvided = false;
+
+        while (tokens.NextBlockLine())
+        {
+            const char* key = tokens.Token();
+
+            if (strcmp(key, "position") == 0)
+                tokens.Read(position);
+            else if (strcmp(key, "lookat") == 0)
+                tokens.Read(lookAt);
+            else if (strcmp(key, "aperture") == 0)
+                tokens.Read(aperture);
+            else if (strcmp(key, "focaldist") == 0)
+                tokens.Read(focalDist);
+            else if (strcmp(key, "fov") == 0)
+                tokens.Read(fov);
+            else if (strcmp(key, "matrix") == 0)
+                matrixProvided |= tokens.Read(xform);
+        }
+
+        if (matrixProvided)
+        {
+            Vec3 forward = Vec3(xform[2][0], xform[2][1], xform[2][2]);
+            position = Vec3(xform[3][0], xform[3][1], xform[3][2]);
+            lookAt = position + forward;
+        }
+
+        scene->AddCamera(position, lookAt, fov);
+        scene->camera->aperture = aperture;
+        scene->camera->focalDist = focalDist;
+    }
+
+    static void LoadRenderer(SceneTokenizer& tokens, Scene* scene, const std::string& path, RenderOptions& renderOptions)
+    {
+        std::string envMap = "none";
+        std::string sampler = "none";
+
+        while (tokens.NextBlockLine())
+        {
+            const char* key = tokens.Token();
+
+            if (strcmp(key, "envmapfile") == 0)
+                tokens.Read(envMap);
+            else if (strcmp(key, "resolution") == 0)
+                tokens.Read(renderOptions.renderResolution);
+            else if (strcmp(key, "windowresolution") == 0)
+                tokens.Read(renderOptions.windowResolution);
+            else if (strcmp(key, "envmapintensity") == 0)
+                tokens.Read(renderOptions.envMapIntensity);
+            else if (strcmp(key, "maxdepth") == 0)
+                tokens.Read(renderOptions.maxDepth);
+            else if (strcmp(key, "maxspp") == 0)
+                tokens.Read(renderOptions.maxSpp);
+            else if (strcmp(key, "samplesperpass") == 0)
+                tokens.Read(renderOptions.samplesPerPass);
+            else if (strcmp(key, "sampleoffset") == 0)
+                tokens.Read(renderOptions.sampleOffset);
+            else if (strcmp(key, "sampler") == 0)
+                tokens.Read(sampler);
+            else if (strcmp(key, "noisethreshold") == 0)
+                tokens.Read(renderOptions.noiseThreshold);
+            else if (strcmp(key, "tilewidth") == 0)
+                tokens.Read(renderOptions.tileWidth);
+            else if (strcmp(key, "tileheight") == 0)
+                tokens.Read(renderOptions.tileHeight);
+            else if (strcmp(key, "targetframetime") == 0)
+                tokens.Read(renderOptions.targetFrameTime);
+            else if (strcmp(key, "enablerr") == 0)
+                tokens.Read(renderOptions.enableRR);
+            else if (strcmp(key, "rrdepth") == 0)
+                tokens.Read(renderOptions.RRDepth);
+            else if (strcmp(key, "enableefficiencyrr") == 0)
+                tokens.Read(renderOptions.enableEfficiencyRR);
+            else if (strcmp(key, "enabletonemap") == 0)
+                tokens.Read(renderOptions.enableTonemap);
+            else if (strcmp(key, "enableaces") == 0)
+                tokens.Read(renderOptions.enableAces);
+            else if (strcmp(key, "texarraywidth") == 0)
+                tokens.Read(renderOptions.texArrayWidth);
+            else if (strcmp(key, "texarrayheight") == 0)
+                tokens.Read(renderOptions.texArrayHeight);
+            else if (strcmp(key, "openglnormalmap") == 0)
+                tokens.Read(renderOptions.openglNormalMap);
+            else if (strcmp(key, "enabletexcompression") == 0)
+                tokens.Read(renderOptions.enableTexCompression);
+            else if (strcmp(key, "packmaterials") == 0)
+                tokens.Read(renderOptions.packMaterials);
+            else if (strcmp(key, "hideemitters") == 0)
+                tokens.Read(renderOptions.hideEmitters);
+            else if (strcmp(key, "enablebackground") == 0)
+                tokens.Read(renderOptions.enableBackground);
+            else if (strcmp(key, "transparentbackground") == 0)
+                tokens.Read(renderOptions.transparentBackground);
+            else if (strcmp(key, "backgroundcolor") == 0)
+                tokens.Read(renderOptions.backgroundCol);
+            else if (strcmp(key, "independentrendersize") == 0)
+                tokens.Read(renderOptions.independentRenderSize);
+            else if (strcmp(key, "envmaprotation") == 0)
+                tokens.Read(renderOptions.envMapRot);
+            else if (strcmp(key, "enableroughnessmollification") == 0)
+                tokens.Read(renderOptions.enableRoughnessMollification);
+            else if (strcmp(key, "roughnessmollificationamt") == 0)
+                tokens.Read(renderOptions.roughnessMollificationAmt);
+            else if (strcmp(key, "enablevolumemis") == 0)
+                tokens.Read(renderOptions.enableVolumeMIS);
+            else if (strcmp(key, "enablepathguiding") == 0)
+                tokens.Read(renderOptions.enablePathGuiding);
+            else if (strcmp(key, "enableuniformlight") == 0)
+                tokens.Read(renderOptions.enableUniformLight);
+            else if (strcmp(key, "uniformlightcolor") == 0)
+                tokens.Read(renderOptions.uniformLightCol);
+        }
+
+        if (renderOptions.samplesPerPass < 1)
+            renderOptions.samplesPerPass = 1;
+
+        if (envMap != "none")
+        {
+            scene->AddEnvMap(path + envMap);
+            renderOptions.enableEnvMap = true;
+        }
+        else
+            renderOptions.enableEnvMap = false;
+
+        if (sampler == "random")
+            renderOptions.sampler = RandomSampler;
+        else if (sampler == "sobol")
+            renderOptions.sampler = SobolSampler;
+        else if (sampler == "bluenoise")
+            renderOptions.sampler = BlueNoiseSampler;
+
+        if (!renderOptions.independentRenderSize)
+            renderOptions.windowResolution = renderOptions.renderResolution;
+    }
+
+    // Placement of mesh and gltf blocks, either as a matrix or as position, rotation and scale
+    struct Transform
+    {
+        Vec4 rotQuat;
+        Mat4 xform, translate, rot, scale;
+        bool matrixProvided = false;
+
+        // Returns false for keys that aren't part of the transform
+        bool Read(const char* key, SceneTokenizer& tokens)
+        {
+            if (strcmp(key, "matrix") == 0)
+                matrixProvided |= tokens.Read(xform);
+            else if (strcmp(key, "position") == 0)
+                tokens.Read(translate[3][0]) && tokens.Read(translate[3][1]) && tokens.Read(translate[3][2]);
+            else if (strcmp(key, "scale") == 0)
+                tokens.Read(scale[0][0]) && tokens.Read(scale[1][1]) && tokens.Read(scale[2][2]);
+            else if (strcmp(key, "rotation") == 0)
+            {
+                if (tokens.Read(rotQuat.x))
                 {
-                    scene->AddEnvMap(path + envMap);
-                    renderOptions.enableEnvMap = true;
+                    tokens.Read(rotQuat.y) && tokens.Read(rotQuat.z) && tokens.Read(rotQuat.w);
+                    rot = Mat4::QuatToMatrix(rotQuat.x, rotQuat.y, rotQuat.z, rotQuat.w);
                 }
-                else
-                    renderOptions.enableEnvMap = false;
-
-                if (strcmp(enableAces, "false") == 0)
-                    renderOptions.enableAces = false;
-                else if (strcmp(enableAces, "true") == 0)
-                    renderOptions.enableAces = true;
-
-                if (strcmp(enableRR, "false") == 0)
-                    renderOptions.enableRR = false;
-                else if (strcmp(enableRR, "true") == 0)
-                    renderOptions.enableRR = true;
-
-                if (strcmp(openglNormalMap, "false") == 0)
-                    renderOptions.openglNormalMap = false;
-                else if (strcmp(openglNormalMap, "true") == 0)
-                    renderOptions.openglNormalMap = true;
-
-                if (strcmp(hideEmitters, "false") == 0)
-                    renderOptions.hideEmitters = false;
-                else if (strcmp(hideEmitters, "true") == 0)
-                    renderOptions.hideEmitters = true;
-
-                if (strcmp(enableBackground, "false") == 0)
-                    renderOptions.enableBackground = false;
-                else if (strcmp(enableBackground, "true") == 0)
-                    renderOptions.enableBackground = true;
-
-                if (strcmp(transparentBackground, "false") == 0)
-                    renderOptions.transparentBackground = false;
-                else if (strcmp(transparentBackground, "true") == 0)
-                    renderOptions.transparentBackground = true;
-
-                if (strcmp(independentRenderSize, "false") == 0)
-                    renderOptions.independentRenderSize = false;
-                else if (strcmp(independentRenderSize, "true") == 0)
-                    renderOptions.independentRenderSize = true;
-
-                if (strcmp(enableTonemap, "false") == 0)
-                    renderOptions.enableTonemap = false;
-                else if (strcmp(enableTonemap, "true") == 0)
-                    renderOptions.enableTonemap = true;
-
-                if (strcmp(enableRoughnessMollification, "false") == 0)
-                    renderOptions.enableRoughnessMollification = false;
-                else if (strcmp(enableRoughnessMollification, "true") == 0)
-                    renderOptions.enableRoughnessMollification = true;
-
-                if (strcmp(enableVolumeMIS, "false") == 0)
-                    renderOptions.enableVolumeMIS = false;
-                else if (strcmp(enableVolumeMIS, "true") == 0)
-                    renderOptions.enableVolumeMIS = true;
-
-                if (strcmp(enableUniformLight, "false") == 0)
-                    renderOptions.enableUniformLight = false;
-                else if (strcmp(enableUniformLight, "true") == 0)
-                    renderOptions.enableUniformLight = true;
-
-                if (!renderOptions.independentRenderSize)
-                    renderOptions.windowResolution = renderOptions.renderResolution;
             }
+            else
+                return false;
+            return true;
+        }
+
+        Mat4 Get() const
+        {
+            return matrixProvided ? xform : scale * rot * translate;
+        }
+    };
 
+    static void LoadMesh(SceneTokenizer& tokens, Scene* scene, const std::string& path, const std::unordered_map<std::string, int>& materialIDs)
+    {
+        std::string filename;
+        Transform transform;
+        int material_id = 0; // Default Material ID
+        std::string meshName = "none";
 
-            //--------------------------------------------
-            // Mesh
+        while (tokens.NextBlockLine())
+        {
+            const char* key = tokens.Token();
 
-            if (strstr(line, "mesh"))
+            if (transform.Read(key, tokens))
+                continue;
+
+            if (strcmp(key, "name") == 0)
             {
-                std::string filename;
-                Vec4 rotQuat;
-                Mat4 xform, translate, rot, scale;
-                int material_id = 0; // Default Material ID
-                char meshName[200] = "none";
-                bool matrixProvided = false;
-
-                while (fgets(line, kMaxLineLength, file))
+                std::string name = tokens.Rest();
+                if (!name.empty())
+                    meshName = name;
+            }
+            else if (strcmp(key, "file") == 0)
+            {
+                std::string file;
+                if (tokens.Read(file))
+                    filename = path + file;
+            }
+            else if (strcmp(key, "material") == 0)
+            {
+                std::string matName;
+                if (tokens.Read(matName))
                 {
-                    // end group
-                    if (strchr(line, '}'))
-                        break;
-
-                    char file[2048];
-                    char matName[100];
-
-                    sscanf(line, " name %[^\t\n]s", meshName);
-
-                    if (sscanf(line, " file %s", file) == 1)
-                        filename = path + file;
-
-                    if (sscanf(line, " material %s", matName) == 1)
-                    {
-                        // look up material in dictionary
-                        if (materialMap.find(matName) != materialMap.end())
-                            material_id = materialMap[matName].id;
-                        else
-                            printf("Could not find material %s\n", matName);
-                    }
-
-                    if (sscanf(line, " matrix %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
-                        &xform[0][0], &xform[1][0], &xform[2][0], &xform[3][0],
-                        &xform[0][1], &xform[1][1], &xform[2][1], &xform[3][1],
-                        &xform[0][2], &xform[1][2], &xform[2][2], &xform[3][2],
-                        &xform[0][3], &xform[1][3], &xform[2][3], &xform[3][3]
-                    ) != 0)
-                        matrixProvided = true;
-
-                    sscanf(line, " position %f %f %f", &translate.data[3][0], &translate.data[3][1], &translate.data[3][2]);
-                    sscanf(line, " scale %f %f %f", &scale.data[0][0], &scale.data[1][1], &scale.data[2][2]);
-                    if (sscanf(line, " rotation %f %f %f %f", &rotQuat.x, &rotQuat.y, &rotQuat.z, &rotQuat.w) != 0)
-                        rot = Mat4::QuatToMatrix(rotQuat.x, rotQuat.y, rotQuat.z, rotQuat.w);
+                    // look up material in dictionary
+                    auto it = materialIDs.find(matName);
+                    if (it != materialIDs.end())
+                        material_id = it->second;
+                    else
+                        printf("Could not find material %s\n", matName.c_str());
                 }
+            }
+        }
+
+        if (!filename.empty())
+        {
+            int mesh_id = scene->AddMesh(filename);
+            if (mesh_id != -1)
+            {
+                std::string instanceName;
 
-                if (!filename.empty())
+                if (meshName != "none")
+                    instanceName = meshName;
+                else
                 {
-                    int mesh_id = scene->AddMesh(filename);
-                    if (mesh_id != -1)
-                    {
-                        std::string instanceName;
-
-                        if (strcmp(meshName, "none") != 0)
-                            instanceName = std::string(meshName);
-                        else
-                        {
-                            std::size_t pos = filename.find_last_of("/\\");
-                            instanceName = filename.substr(pos + 1);
-                        }
-
-                        Mat4 transformMat;
-
-                        if (matrixProvided)
-                            transformMat = xform;
-                        else
-                            transformMat = scale * rot * translate;
-
-                        MeshInstance instance(instanceName, mesh_id, transformMat, material_id);
-                        scene->AddMeshInstance(instance);
-                    }
+                    std::size_t pos = filename.find_last_of("/\\");
+                    instanceName = filename.substr(pos + 1);
                 }
+
+                MeshInstance instance(instanceName, mesh_id, transform.Get(), material_id);
+                scene->AddMeshInstance(instance);
             }
+        }
+    }
+
+    static void LoadGLTFBlock(SceneTokenizer& tokens, Scene* scene, const std::string& path, RenderOptions& renderOptions)
+    {
+        std::string filename;
+        Transform transform;
 
-            //--------------------------------------------
-            // GLTF
+        while (tokens.NextBlockLine())
+        {
+            const char* key = tokens.Token();
+
+            if (transform.Read(key, tokens))
+                continue;
 
-            if (strstr(line, "gltf"))
+            if (strcmp(key, "file") == 0)
             {
-                std::string filename;
-                Vec4 rotQuat;
-                Mat4 xform, translate, rot, scale;
-                bool matrixProvided = false;
+                std::string file;
+                if (tokens.Read(file))
+                    filename = path + file;
+            }
+        }
 
-                while (fgets(line, kMaxLineLength, file))
-                {
-                    // end group
-                    if (strchr(line, '}'))
-                        break;
-
-                    char file[2048];
-
-                    if (sscanf(line, " file %s", file) == 1)
-                        filename = path + file;
-
-                    if (sscanf(line, " matrix %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
-                        &xform[0][0], &xform[1][0], &xform[2][0], &xform[3][0],
-                        &xform[0][1], &xform[1][1], &xform[2][1], &xform[3][1],
-                        &xform[0][2], &xform[1][2], &xform[2][2], &xform[3][2],
-                        &xform[0][3], &xform[1][3], &xform[2][3], &xform[3][3]
-                    ) != 0)
-                        matrixProvided = true;
-
-                    sscanf(line, " position %f %f %f", &translate.data[3][0], &translate.data[3][1], &translate.data[3][2]);
-                    sscanf(line, " scale %f %f %f", &scale.data[0][0], &scale.data[1][1], &scale.data[2][2]);
-                    if (sscanf(line, " rotation %f %f %f %f", &rotQuat.x, &rotQuat.y, &rotQuat.z, &rotQuat.w) != 0)
-                        rot = Mat4::QuatToMatrix(rotQuat.x, rotQuat.y, rotQuat.z, rotQuat.w);
-                }
+        if (!filename.empty())
+        {
+            std::string ext = filename.substr(filename.find_last_of(".") + 1);
 
-                if (!filename.empty())
-                {
-                    std::string ext = filename.substr(filename.find_last_of(".") + 1);
+            bool success = false;
+            Mat4 transformMat = transform.Get();
 
-                    bool success = false;
-                    Mat4 transformMat;
+            // TODO: Add support for instancing.
+            // If the same gltf is loaded multiple times then mesh data gets duplicated
+            if (ext == "gltf")
+                success = LoadGLTF(filename, scene, renderOptions, transformMat, false);
+            else if (ext == "glb")
+                success = LoadGLTF(filename, scene, renderOptions, transformMat, true);
 
-                    if (matrixProvided)
-                        transformMat = xform;
-                    else
-                        transformMat = scale * rot * translate;
-
-                    // TODO: Add support for instancing.
-                    // If the same gltf is loaded multiple times then mesh data gets duplicated
-                    if (ext == "gltf")
-                        success = LoadGLTF(filename, scene, renderOptions, transformMat, false);
-                    else if (ext == "glb")
-                        success = LoadGLTF(filename, scene, renderOptions, transformMat, true);
-
-                    if (!success)
-                    {
-                        printf("Unable to load gltf %s\n", filename.c_str());
-                        exit(0);
-                    }
-                }
+            if (!success)
+            {
+                printf("Unable to load gltf %s\n", filename.c_str());
+                exit(0);
             }
         }
+    }
 
-        fclose(file);
+    bool LoadSceneFromFile(const std::string& filename, Scene* scene, RenderOptions& renderOptions)
+    {
+        std::vector<char> text;
+
+        if (!ReadFile(filename, text))
+        {
+            printf("Couldn't open %s for reading\n", filename.c_str());
+            return false;
+        }
+
+        printf("Loading Scene..\n");
+
+        // Material names to scene material IDs
+        std::unordered_map<std::string, int> materialIDs;
+        std::string path = filename.substr(0, filename.find_last_of("/\\")) + "/";
+
+        //Defaults
+        Material defaultMat;
+        scene->AddMaterial(defaultMat);
+
+        SceneTokenizer tokens(text.data());
+
+        while (tokens.NextLine())
+        {
+            const char* section = tokens.Token();
+
+            // skip comments
+            if (section[0] == '#')
+                continue;
+
+            if (strcmp(section, "material") == 0)
+            {
+                // name used for materials
+                std::string name;
+                if (tokens.Read(name))
+                    LoadMaterial(tokens, scene, path, name, materialIDs);
+            }
+            else if (strcmp(section, "light") == 0)
+                LoadLight(tokens, scene);
+            else if (strcmp(section, "camera") == 0)
+                LoadCamera(tokens, scene);
+            else if (strcmp(section, "renderer") == 0)
+                LoadRenderer(tokens, scene, path, renderOptions);
+            else if (strcmp(section, "mesh") == 0)
+                LoadMesh(tokens, scene, path, materialIDs);
+            else if (strcmp(section, "gltf") == 0)
+                LoadGLTFBlock(tokens, scene, path, renderOptions);
+        }
 
         return true;
     }
@@ -0,0 +1,234 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "SceneLoader.h"
+#include "Scene.h"
+
+namespace GLSLPT
+{
+    SceneLoader::SceneLoader(Scene* scene, int numThreads)
+        : scene(scene)
+        , numMeshes(scene->meshes.size())
+        , numTextures(scene->textures.size())
+        , nextJob(0)
+        , meshesDone(0)
+        , texturesDone(0)
+        , cancel(false)
+    {
+        // Meshes from a GLTF are already read and only need their BVH.
+        // Textures are decoded into textures of their own so the scene keeps its placeholders until FinishTextures()
+        meshPending.resize(numMeshes);
+        meshFailed.assign(numMeshes, 0);
+        for (int i = 0; i < numMeshes; i++)
+            meshPending[i] = scene->meshes[i]->verticesUVX.empty();
+
+        texturePending.resize(numTextures);
+        decoded.assign(numTextures, nullptr);
+        for (int i = 0; i < numTextures; i++)
+            texturePending[i] = scene->textures[i]->texData.empty();
+
+        if (numThreads <= 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        numThreads = std::min(numThreads, std::max(1, numMeshes + numTextures));
+
+        for (int i = 0; i < numThreads; i++)
+            threads.emplace_back(&SceneLoader::Work, this);
+    }
+
+    SceneLoader::~SceneLoader()
+    {
+        cancel = true;
+        Wait();
+
+        for (Texture* texture : decoded)
+            delete texture;
+    }
+
+    void SceneLoader::Wait()
+    {
+        for (std::thread& thread : threads)
+            if (thread.joinable())
+                thread.join();
+    }
+
+    void SceneLoader::Work()
+    {
+        // Meshes are queued first so that the scene can be shown as early as possible
+        while (!cancel)
+        {
+            int job = nextJob++;
+            if (job >= numMeshes + numTextures)
+                break;
+
+            if (job < numMeshes)
+            {
+                Mesh* mesh = scene->meshes[job];
+                if (meshPending[job])
+                {
+                    printf("Loading model %s\n", mesh->name.c_str());
+                    meshFailed[job] = !mesh->LoadFromFile(mesh->name);
+                }
+
+                if (!meshFailed[job])
+                {
+                    printf("Building BVH for %s\n", mesh->name.c_str());
+                    mesh->BuildBVH();
+                }
+                meshesDone++;
+            }
+            else
+            {
+                int i = job - numMeshes;
+                const Texture* source = scene->textures[i];
+                if (texturePending[i])
+                {
+                    printf("Loading texture %s\n", source->name.c_str());
+                    Texture* texture = new Texture;
+                    bool loaded = source->encodedData.empty() ? texture->LoadTexture(source->name)
+                        : texture->LoadTexture(&source->encodedData[0], source->encodedData.size());
+
+                    if (loaded)
+                    {
+                        texture->name = source->name;
+                        decoded[i] = texture;
+                    }
+                    else
+                        delete texture;
+                }
+                texturesDone++;
+            }
+        }
+    }
+
+    void SceneLoader::FinishMeshes()
+    {
+        std::vector<int> meshIDs(numMeshes, -1);
+        std::vector<Mesh*> meshes;
+        scene->meshIDs.clear();
+        for (int i = 0; i < numMeshes; i++)
+        {
+            if (meshFailed[i])
+            {
+                printf("Unable to load model %s\n", scene->meshes[i]->name.c_str());
+                numFailed++;
+                delete scene->meshes[i];
+                continue;
+            }
+            meshIDs[i] = meshes.size();
+            scene->meshIDs.emplace(scene->meshes[i]->name, meshIDs[i]);
+            meshes.push_back(scene->meshes[i]);
+        }
+        scene->meshes = meshes;
+
+        std::vector<MeshInstance> meshInstances;
+        for (MeshInstance& instance : scene->meshInstances)
+        {
+            if (meshIDs[instance.meshID] == -1)
+                continue;
+            instance.meshID = meshIDs[instance.meshID];
+            meshInstances.push_back(instance);
+        }
+        scene->meshInstances = meshInstances;
+
+        // The placeholders take the values of the material that uses them, so the preview doesn't change much
+        // when the actual textures arrive
+        auto setPlaceholder = [this](float texID, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+        {
+            if (texID < 0 || !texturePending[(int)texID])
+                return;
+            Texture* texture = scene->textures[(int)texID];
+            if (!texture->texData.empty())
+                return;
+            texture->width = 1;
+            texture->height = 1;
+            texture->components = 4;
+            texture->texData = { r, g, b, a };
+        };
+
+        auto toSRGB = [](float x) { return (unsigned char)Math::FloatToUnorm8(std::pow(Math::Clamp(x, 0.0f, 1.0f), 1.0f / 2.2f)); };
+        auto toUnorm = [](float x) { return (unsigned char)Math::FloatToUnorm8(x); };
+
+        for (const Material& mat : scene->materials)
+        {
+            setPlaceholder(mat.baseColorTexId, toSRGB(mat.baseColor.x), toSRGB(mat.baseColor.y), toSRGB(mat.baseColor.z), 255);
+            setPlaceholder(mat.metallicRoughnessTexID, 0, toUnorm(mat.roughness), toUnorm(mat.metallic), 255);
+            setPlaceholder(mat.normalmapTexID, 128, 128, 255, 255);
+            setPlaceholder(mat.emissionmapTexID, toSRGB(mat.emission.x), toSRGB(mat.emission.y), toSRGB(mat.emission.z), 255);
+        }
+
+        // Textures no material refers to
+        for (int i = 0; i < numTextures; i++)
+            setPlaceholder(i, 255, 255, 255, 255);
+    }
+
+    void SceneLoader::FinishTextures()
+    {
+        std::vector<int> texIDs(numTextures, -1);
+        std::vector<Texture*> textures;
+        scene->textureIDs.clear();
+        for (int i = 0; i < numTextures; i++)
+        {
+            Texture* texture = scene->textures[i];
+            if (texturePending[i])
+            {
+                texturePending[i] = 0;
+                if (!decoded[i])
+                {
+                    printf("Unable to load texture %s\n", texture->name.c_str());
+                    numFailed++;
+                    delete texture;
+                    continue;
+                }
+
+                delete texture;
+                texture = decoded[i];
+                decoded[i] = nullptr;
+            }
+            texIDs[i] = textures.size();
+            scene->textureIDs.emplace(texture->name, texIDs[i]);
+            textures.push_back(texture);
+        }
+
+        // Materials fall back to their own values for textures that couldn't be read
+        auto remap = [&texIDs](float& texID)
+        {
+            if (texID >= 0)
+                texID = texIDs[(int)texID];
+        };
+
+        for (Material& mat : scene->materials)
+        {
+            remap(mat.baseColorTexId);
+            remap(mat.metallicRoughnessTexID);
+            remap(mat.normalmapTexID);
+            remap(mat.emissionmapTexID);
+        }
+        scene->textures = textures;
+
+        if (scene->initialized)
+            scene->UpdateTextures();
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+
+namespace GLSLPT
+{
+    class Scene;
+    class Texture;
+
+    // Reads the meshes and textures of a scene created with deferLoading on a pool of worker threads.
+    // Each mesh gets its BVH built as soon as it was read, so the scene can be processed and rendered
+    // with placeholder textures while the (usually much slower) texture decoding is still in progress
+    class SceneLoader
+    {
+    public:
+        SceneLoader(Scene* scene, int numThreads = 0);
+        ~SceneLoader();
+
+        bool MeshesLoaded() const { return meshesDone.load() == numMeshes; }
+        bool TexturesLoaded() const { return texturesDone.load() == numTextures; }
+        int NumLoaded() const { return meshesDone.load() + texturesDone.load(); }
+        int NumAssets() const { return numMeshes + numTextures; }
+        int NumFailed() const { return numFailed; }
+
+        // Blocks until every mesh and texture was read
+        void Wait();
+
+        // Called on the main thread once the meshes are loaded. Drops meshes that couldn't be read along with
+        // their instances and gives the textures that are still pending a 1x1 placeholder
+        void FinishMeshes();
+
+        // Called on the main thread once the textures are loaded. Moves the decoded textures into the scene
+        // and repacks them if the scene was already processed
+        void FinishTextures();
+
+    private:
+        void Work();
+
+        Scene* scene;
+        int numMeshes;
+        int numTextures;
+        int numFailed = 0;
+        std::vector<char> meshPending;
+        std::vector<char> meshFailed;
+        std::vector<char> texturePending;
+        std::vector<Texture*> decoded; // nullptr if decoding failed
+        std::vector<std::thread> threads;
+
+        std::atomic<int> nextJob;
+        std::atomic<int> meshesDone;
+        std::atomic<int> texturesDone;
+        std::atomic<bool> cancel;
+    };
+}
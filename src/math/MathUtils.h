@@ -27,6 +27,7 @@
 #define PI 3.14159265358979323846f
 
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 #include "Config.h"
 
@@ -39,5 +40,49 @@ namespace GLSLPT
         static inline float Degrees(float radians) { return radians * (180.f / PI); };
         static inline float Radians(float degrees) { return degrees * (PI / 180.f); };
         static inline float Clamp(float x, float lower, float upper) { return std::min(upper, std::max(x, lower)); };
+
+        // IEEE half float bits, rounded to nearest. Values beyond the half range are clamped to the largest half
+        static inline unsigned short FloatToHalf(float f)
+        {
+            unsigned int x;
+            memcpy(&x, &f, sizeof(x));
+
+            unsigned int sign = (x >> 16) & 0x8000;
+            unsigned int mant = x & 0x7FFFFF;
+            int exp = (int)((x >> 23) & 0xFF) - 127 + 15;
+
+            if (((x >> 23) & 0xFF) == 0xFF)
+                return sign | 0x7C00 | (mant ? 0x200 : 0);
+            if (exp >= 31)
+                return sign | 0x7BFF;
+
+            // Denormals
+            if (exp <= 0)
+            {
+                if (exp < -10)
+                    return sign;
+                mant |= 0x800000;
+                int shift = 14 - exp;
+                unsigned int h = (mant >> shift) + ((mant >> (shift - 1)) & 1);
+                return sign | h;
+            }
+
+            unsigned int h = (exp << 10) | (mant >> 13);
+            h += (mant >> 12) & 1;
+            return sign | std::min(h, 0x7BFFu);
+        };
+
+        static inline unsigned int FloatToUnorm8(float f) { return (unsigned int)(Clamp(f, 0.0f, 1.0f) * 255.0f + 0.5f); };
+
+        // FNV-1a over a byte range, continuing from hash. Hashes start from HashSeed
+        static const unsigned long long HashSeed = 14695981039346656037ull;
+
+        static inline unsigned long long HashBytes(unsigned long long hash, const void* data, size_t size)
+        {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; i++)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            return hash;
+        };
     };
 }
\ No newline at end of file
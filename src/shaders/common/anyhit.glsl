@@ -122,15 +122,28 @@ bool AnyHit(Ray r, float maxDist)
 
                     vec2 texCoord = t0 * uvt.w + t1 * uvt.x + t2 * uvt.y;
 
+#ifdef OPT_PACKED_MATERIALS
+                    uvec4 alphaParams = texelFetch(materialsTex, ivec2(currMatID * 3 + 1, 0), 0);
+                    int baseColorTexID = UnpackTexIDs(texelFetch(materialsTex, ivec2(currMatID * 3 + 2, 0), 0).x).x;
+
+                    vec4 factors = UnpackUnorm4(alphaParams.z);
+                    float opacity = factors.y;
+                    int alphaMode = int(alphaParams.z >> 28);
+                    float alphaCutoff = factors.z;
+#else
                     vec4 texIDs      = texelFetch(materialsTex, ivec2(currMatID * 8 + 6, 0), 0);
                     vec4 alphaParams = texelFetch(materialsTex, ivec2(currMatID * 8 + 7, 0), 0);
+                    int baseColorTexID = int(texIDs.x);
                     
-                    float alpha = texture(textureMapsArrayTex, vec3(texCoord, texIDs.x)).a;
-
                     float opacity = alphaParams.x;
                     int alphaMode = int(alphaParams.y);
                     float alphaCutoff = alphaParams.z;
-                    opacity *= alpha;
+#endif
+
+#ifdef OPT_TEXTURES
+                    if (baseColorTexID >= 0)
+                        opacity *= SampleTexture(baseColorTexID, texCoord).a;
+#endif
 
                     // Ignore intersection and continue ray based on alpha test
                     if (!((alphaMode == ALPHA_MODE_MASK && opacity < alphaCutoff) || 
@@ -246,7 +246,8 @@ if(state.depth > 0)
         state.normal = normalize(transpose(inverse(mat3(transform))) * normal);
         state.ffnormal = dot(state.normal, r.direction) <= 0.0 ? state.normal : -state.normal;
 
-        // Calculate tangent and bitangent
+#ifdef OPT_TEXTURES
+        // Calculate tangent and bitangent (only used by normal maps)
         vec3 deltaPos1 = vert1.xyz - vert0.xyz;
         vec3 deltaPos2 = vert2.xyz - vert0.xyz;
 
@@ -260,6 +261,12 @@ if(state.depth > 0)
 
         state.tangent = normalize(mat3(transform) * state.tangent);
         state.bitangent = normalize(mat3(transform) * state.bitangent);
+
+        // Texel to world area ratio of the triangle for ray cone texture LOD
+        float uvArea = abs(deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+        float worldArea = length(cross(mat3(transform) * deltaPos1, mat3(transform) * deltaPos2));
+        state.texLodBias = 0.5 * log2(max(uvArea, 1e-12) / max(worldArea, 1e-12));
+#endif
     }
 
     return true;
@@ -55,7 +55,11 @@ void TintColors(Material mat, float eta, out float F0, out vec3 Csheen, out vec3
     F0 *= F0;
     
     Cspec0 = F0 * mix(vec3(1.0), ctint, mat.specularTint);
+#ifdef OPT_SHEEN
     Csheen = mix(vec3(1.0), ctint, mat.sheenTint);
+#else
+    Csheen = vec3(0.0);
+#endif
 }
 
 vec3 EvalDisneyDiffuse(Material mat, vec3 Csheen, vec3 V, vec3 L, vec3 H, out float pdf)
@@ -80,8 +84,12 @@ vec3 EvalDisneyDiffuse(Material mat, vec3 Csheen, vec3 V, vec3 L, vec3 H, out fl
     float ss = 1.25 * (Fss * (1.0 / (L.z + V.z) - 0.5) + 0.5);
 
     // Sheen
+#ifdef OPT_SHEEN
     float FH = SchlickWeight(LDotH);
     vec3 Fsheen = FH * mat.sheen * Csheen;
+#else
+    vec3 Fsheen = vec3(0.0);
+#endif
 
     pdf = L.z * INV_PI;
     return INV_PI * mat.baseColor * mix(Fd + Fretro, ss, mat.subsurface) + Fsheen;
@@ -93,9 +101,16 @@ vec3 EvalMicrofacetReflection(Material mat, vec3 V, vec3 L, vec3 H, vec3 F, out
     if (L.z <= 0.0)
         return vec3(0.0);
 
+#ifdef OPT_ANISO
     float D = GTR2Aniso(H.z, H.x, H.y, mat.ax, mat.ay);
     float G1 = SmithGAniso(abs(V.z), V.x, V.y, mat.ax, mat.ay);
     float G2 = G1 * SmithGAniso(abs(L.z), L.x, L.y, mat.ax, mat.ay);
+#else
+    // ax == ay so the isotropic forms give the same result
+    float D = GTR2(H.z, mat.ax);
+    float G1 = SmithG(abs(V.z), mat.ax);
+    float G2 = G1 * SmithG(abs(L.z), mat.ax);
+#endif
 
     pdf = G1 * D / (4.0 * V.z);
     return F * D * G2 / (4.0 * L.z * V.z);
@@ -110,9 +125,16 @@ vec3 EvalMicrofacetRefraction(Material mat, float eta, vec3 V, vec3 L, vec3 H, v
     float LDotH = dot(L, H);
     float VDotH = dot(V, H);
 
+#ifdef OPT_ANISO
     float D = GTR2Aniso(H.z, H.x, H.y, mat.ax, mat.ay);
     float G1 = SmithGAniso(abs(V.z), V.x, V.y, mat.ax, mat.ay);
     float G2 = G1 * SmithGAniso(abs(L.z), L.x, L.y, mat.ax, mat.ay);
+#else
+    // ax == ay so the isotropic forms give the same result
+    float D = GTR2(H.z, mat.ax);
+    float G1 = SmithG(abs(V.z), mat.ax);
+    float G2 = G1 * SmithG(abs(L.z), mat.ax);
+#endif
     float denom = LDotH + VDotH * eta;
     denom *= denom;
     float eta2 = eta * eta;
@@ -143,8 +165,9 @@ vec3 DisneySample(State state, vec3 V, vec3 N, out vec3 L, out float pdf)
 {
     pdf = 0.0;
 
-    float r1 = rand();
-    float r2 = rand();
+    vec2 r = Sample2D(DIM_BSDF);
+    float r1 = r.x;
+    float r2 = r.y;
 
     // TODO: Tangent and bitangent should be calculated from mesh (provided, the mesh has proper uvs)
     vec3 T, B;
@@ -159,9 +182,14 @@ vec3 DisneySample(State state, vec3 V, vec3 N, out vec3 L, out float pdf)
     TintColors(state.mat, state.eta, F0, Csheen, Cspec0);
 
     // Model weights
+#ifdef OPT_SPEC_TRANS
     float dielectricWt = (1.0 - state.mat.metallic) * (1.0 - state.mat.specTrans);
-    float metalWt = state.mat.metallic;
     float glassWt = (1.0 - state.mat.metallic) * state.mat.specTrans;
+#else
+    float dielectricWt = 1.0 - state.mat.metallic;
+    float glassWt = 0.0;
+#endif
+    float metalWt = state.mat.metallic;
 
     // Lobe probabilities
     float schlickWt = SchlickWeight(V.z);
@@ -170,7 +198,11 @@ vec3 DisneySample(State state, vec3 V, vec3 N, out vec3 L, out float pdf)
     float dielectricPr = dielectricWt * Luminance(mix(Cspec0, vec3(1.0), schlickWt));
     float metalPr = metalWt * Luminance(mix(state.mat.baseColor, vec3(1.0), schlickWt));
     float glassPr = glassWt;
+#ifdef OPT_CLEARCOAT
     float clearCtPr = 0.25 * state.mat.clearcoat;
+#else
+    float clearCtPr = 0.0;
+#endif
 
     // Normalize probabilities
     float invTotalWt = 1.0 / (diffPr + dielectricPr + metalPr + glassPr + clearCtPr);
@@ -189,13 +221,18 @@ vec3 DisneySample(State state, vec3 V, vec3 N, out vec3 L, out float pdf)
     cdf[4] = cdf[3] + clearCtPr;
 
     // Sample a lobe based on its importance
-    float r3 = rand();
+    float r3 = Sample1D(DIM_BSDF_LOBE);
 
     if (r3 < cdf[0]) // Diffuse
     {
         L = CosineSampleHemisphere(r1, r2);
     }
+    // Lobes that no material in the scene uses are compiled out, the last remaining one takes the rest of the range
+#if defined(OPT_SPEC_TRANS) || defined(OPT_CLEARCOAT)
     else if (r3 < cdf[2]) // Dielectric + Metallic reflection
+#else
+    else // Dielectric + Metallic reflection
+#endif
     {
         vec3 H = SampleGGXVNDF(V, state.mat.ax, state.mat.ay, r1, r2);
 
@@ -204,7 +241,12 @@ vec3 DisneySample(State state, vec3 V, vec3 N, out vec3 L, out float pdf)
 
         L = normalize(reflect(-V, H));
     }
+#ifdef OPT_SPEC_TRANS
+#ifdef OPT_CLEARCOAT
     else if (r3 < cdf[3]) // Glass
+#else
+    else // Glass
+#endif
     {
         vec3 H = SampleGGXVNDF(V, state.mat.ax, state.mat.ay, r1, r2);
         float F = DielectricFresnel(abs(dot(V, H)), state.eta);
@@ -225,6 +267,8 @@ vec3 DisneySample(State state, vec3 V, vec3 N, out vec3 L, out float pdf)
             L = normalize(refract(-V, H, state.eta));
         }
     }
+#endif
+#ifdef OPT_CLEARCOAT
     else // Clearcoat
     {
         vec3 H = SampleGTR1(state.mat.clearcoatRoughness, r1, r2);
@@ -234,6 +278,7 @@ vec3 DisneySample(State state, vec3 V, vec3 N, out vec3 L, out float pdf)
 
         L = normalize(reflect(-V, H));
     }
+#endif
 
     L = ToWorld(T, B, N, L);
     V = ToWorld(T, B, N, V);
@@ -269,9 +314,14 @@ vec3 DisneyEval(State state, vec3 V, vec3 N, vec3 L, out float pdf)
     TintColors(state.mat, state.eta, F0, Csheen, Cspec0);
 
     // Model weights
+#ifdef OPT_SPEC_TRANS
     float dielectricWt = (1.0 - state.mat.metallic) * (1.0 - state.mat.specTrans);
-    float metalWt = state.mat.metallic;
     float glassWt = (1.0 - state.mat.metallic) * state.mat.specTrans;
+#else
+    float dielectricWt = 1.0 - state.mat.metallic;
+    float glassWt = 0.0;
+#endif
+    float metalWt = state.mat.metallic;
 
     // Lobe probabilities
     float schlickWt = SchlickWeight(V.z);
@@ -280,7 +330,11 @@ vec3 DisneyEval(State state, vec3 V, vec3 N, vec3 L, out float pdf)
     float dielectricPr = dielectricWt * Luminance(mix(Cspec0, vec3(1.0), schlickWt));
     float metalPr = metalWt * Luminance(mix(state.mat.baseColor, vec3(1.0), schlickWt));
     float glassPr = glassWt;
+#ifdef OPT_CLEARCOAT
     float clearCtPr = 0.25 * state.mat.clearcoat;
+#else
+    float clearCtPr = 0.0;
+#endif
 
     // Normalize probabilities
     float invTotalWt = 1.0 / (diffPr + dielectricPr + metalPr + glassPr + clearCtPr);
@@ -323,6 +377,7 @@ vec3 DisneyEval(State state, vec3 V, vec3 N, vec3 L, out float pdf)
     }
 
     // Glass/Specular BSDF
+#ifdef OPT_SPEC_TRANS
     if (glassPr > 0.0)
     {
         // Dielectric fresnel (achromatic)
@@ -339,13 +394,16 @@ vec3 DisneyEval(State state, vec3 V, vec3 N, vec3 L, out float pdf)
             pdf += tmpPdf * glassPr * (1.0 - F);
         }
     }
+#endif
 
     // Clearcoat
+#ifdef OPT_CLEARCOAT
     if (clearCtPr > 0.0 && reflect)
     {
         f += EvalClearcoat(state.mat, V, L, H, tmpPdf) * 0.25 * state.mat.clearcoat;
         pdf += tmpPdf * clearCtPr;
     }
+#endif
 
     return f * abs(L.z);
 }
\ No newline at end of file
@@ -67,7 +67,7 @@ vec4 EvalEnvMap(Ray r)
 
 vec4 SampleEnvMap(inout vec3 color)
 {
-    vec2 uv = BinarySearch(rand() * envMapTotalSum);
+    vec2 uv = BinarySearch(Sample1D(DIM_ENVMAP) * envMapTotalSum);
 
     color = texture(envMapTex, uv).rgb;
     float pdf = Luminance(color) / envMapTotalSum;
@@ -80,17 +80,6 @@ struct Material
     Medium medium;
 };
 
-struct Camera
-{
-    vec3 up;
-    vec3 right;
-    vec3 forward;
-    vec3 position;
-    float fov;
-    float focalDist;
-    float aperture;
-};
-
 struct Light
 {
     vec3 position;
@@ -117,7 +106,13 @@ struct State
     bool isEmitter;
 
     vec2 texCoord;
+    float texLodBias;
     int matID;
+
+    // Ray cone for texture LOD selection
+    float coneWidth;
+    float coneSpread;
+
     Material mat;
     Medium medium;
 };
@@ -138,8 +133,6 @@ struct LightSampleRec
     float pdf;
 };
 
-uniform Camera camera;
-
 //RNG from code by Moroz Mykhailo (https://www.shadertoy.com/view/wltcRS)
 
 //internal RNG state 
@@ -173,4 +166,28 @@ vec3 FaceForward(vec3 a, vec3 b)
 float Luminance(vec3 c)
 {
     return 0.212671 * c.x + 0.715160 * c.y + 0.072169 * c.z;
-}
\ No newline at end of file
+}
+
+// Decoding of the packed material layout (see PackedMaterial in Material.h)
+float UnpackHalf(uint h)
+{
+    // Rebias the exponent by scaling, which also handles denormals
+    float f = uintBitsToFloat((h & 0x7FFFu) << 13) * 5.192296858534828e33;
+    return (h & 0x8000u) != 0u ? -f : f;
+}
+
+vec2 UnpackHalf2(uint v)
+{
+    return vec2(UnpackHalf(v & 0xFFFFu), UnpackHalf(v >> 16));
+}
+
+vec4 UnpackUnorm4(uint v)
+{
+    return vec4(uvec4(v, v >> 8, v >> 16, v >> 24) & 0xFFu) / 255.0;
+}
+
+ivec2 UnpackTexIDs(uint v)
+{
+    ivec2 ids = ivec2(v & 0xFFFFu, v >> 16);
+    return ivec2(ids.x == 0xFFFF ? -1 : ids.x, ids.y == 0xFFFF ? -1 : ids.y);
+}
@@ -0,0 +1,117 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifdef OPT_GUIDING
+
+// Path guiding distributions learned on the CPU (PathGuide). Each texture row is a grid cell holding the CDF over
+// OPT_GUIDING_RES x OPT_GUIDING_RES equal-area direction bins, followed by the number of records the cell learned from
+// and the incident radiance integrated over the sphere
+uniform sampler2D guideTex;
+uniform vec3 guideGridMin;
+uniform vec3 guideInvCellSize;
+uniform ivec3 guideGridRes;
+
+#define GUIDE_NUM_BINS (OPT_GUIDING_RES * OPT_GUIDING_RES)
+
+// Cell of the current surface vertex and the probability that it samples the guide rather than the BSDF.
+// Light sampling needs the same mixture pdf as the scattered ray for its MIS weights
+int guideCell;
+float guideProb;
+
+int GuideCell(vec3 p)
+{
+    ivec3 c = clamp(ivec3((p - guideGridMin) * guideInvCellSize), ivec3(0), guideGridRes - 1);
+    return (c.z * guideGridRes.y + c.y) * guideGridRes.x + c.x;
+}
+
+bool GuideTrained(int cell)
+{
+    return texelFetch(guideTex, ivec2(GUIDE_NUM_BINS, cell), 0).r > 0.0;
+}
+
+float GuideIrradiance(int cell)
+{
+    return texelFetch(guideTex, ivec2(GUIDE_NUM_BINS + 1, cell), 0).r;
+}
+
+float GuideBinPdf(int cell, int bin)
+{
+    float cdfPrev = bin > 0 ? texelFetch(guideTex, ivec2(bin - 1, cell), 0).r : 0.0;
+    float binPr = texelFetch(guideTex, ivec2(bin, cell), 0).r - cdfPrev;
+
+    // Bins all cover a solid angle of 4 * PI / GUIDE_NUM_BINS
+    return binPr * float(GUIDE_NUM_BINS) / (4.0 * PI);
+}
+
+// Bins are uniform in phi along x and in cos(theta) along y. PathGuide::AddRecord() bins its records the same way
+// and SampleGuide() inverts the mapping
+int GuideBin(vec3 dir)
+{
+    float phi = atan(dir.y, dir.x);
+    if (phi < 0.0)
+        phi += TWO_PI;
+    int x = min(int(phi * INV_TWO_PI * float(OPT_GUIDING_RES)), OPT_GUIDING_RES - 1);
+    int y = clamp(int((dir.z + 1.0) * 0.5 * float(OPT_GUIDING_RES)), 0, OPT_GUIDING_RES - 1);
+    return y * OPT_GUIDING_RES + x;
+}
+
+float GuidePdf(int cell, vec3 dir)
+{
+    return GuideBinPdf(cell, GuideBin(dir));
+}
+
+float GuidedPdf(float bsdfPdf, vec3 dir)
+{
+    return (guideProb > 0.0 && bsdfPdf > 0.0) ? mix(bsdfPdf, GuidePdf(guideCell, dir), guideProb) : bsdfPdf;
+}
+
+vec3 SampleGuide(int cell, vec2 r, out float pdf)
+{
+    // Find the bin by a binary search over the CDF of the cell
+    int lo = 0;
+    int hi = GUIDE_NUM_BINS - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) >> 1;
+        if (r.x < texelFetch(guideTex, ivec2(mid, cell), 0).r)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    // Rescale the random number for reuse within the bin
+    float cdfPrev = lo > 0 ? texelFetch(guideTex, ivec2(lo - 1, cell), 0).r : 0.0;
+    float cdf = texelFetch(guideTex, ivec2(lo, cell), 0).r;
+    float u = clamp((r.x - cdfPrev) / max(cdf - cdfPrev, 1e-7), 0.0, 1.0);
+
+    float cosTheta = float(lo / OPT_GUIDING_RES) + u;
+    cosTheta = cosTheta / float(OPT_GUIDING_RES) * 2.0 - 1.0;
+    float phi = (float(lo % OPT_GUIDING_RES) + r.y) / float(OPT_GUIDING_RES) * TWO_PI;
+    float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+
+    pdf = (cdf - cdfPrev) * float(GUIDE_NUM_BINS) / (4.0 * PI);
+    return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+}
+
+#endif
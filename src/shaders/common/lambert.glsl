@@ -24,8 +24,9 @@
 
 vec3 LambertSample(inout State state, vec3 V, vec3 N, inout vec3 L, inout float pdf)
 {
-    float r1 = rand();
-    float r2 = rand();
+    vec2 r = Sample2D(DIM_BSDF);
+    float r1 = r.x;
+    float r2 = r.y;
 
     vec3 T, B;
     Onb(N, T, B);
@@ -24,10 +24,56 @@
 
 void GetMaterial(inout State state, in Ray r)
 {
-    int index = state.matID * 8;
     Material mat;
     Medium medium;
 
+#ifdef OPT_PACKED_MATERIALS
+    int index = state.matID * 3;
+
+    uvec4 param1 = texelFetch(materialsTex, ivec2(index + 0, 0), 0);
+    uvec4 param2 = texelFetch(materialsTex, ivec2(index + 1, 0), 0);
+    uvec4 param3 = texelFetch(materialsTex, ivec2(index + 2, 0), 0);
+
+    vec2 colorRG           = UnpackHalf2(param1.x);
+    vec2 colorBRgh         = UnpackHalf2(param1.y);
+    vec2 emissionRG        = UnpackHalf2(param1.z);
+    vec2 emissionBIor      = UnpackHalf2(param1.w);
+    vec4 factors1          = UnpackUnorm4(param2.x);
+    vec4 factors2          = UnpackUnorm4(param2.y);
+    vec4 factors3          = UnpackUnorm4(param2.z);
+    vec2 mediumParams      = UnpackHalf2(param2.w);
+    vec2 mediumColorRG     = UnpackHalf2(param3.z);
+    vec2 mediumColorB      = UnpackHalf2(param3.w);
+
+    mat.baseColor          = vec3(colorRG, colorBRgh.x);
+    mat.anisotropic        = factors1.w;
+
+    mat.emission           = vec3(emissionRG, emissionBIor.x);
+
+    mat.metallic           = factors1.x;
+    mat.roughness          = max(colorBRgh.y, 0.001);
+    mat.subsurface         = factors1.y;
+    mat.specularTint       = factors1.z;
+
+    mat.sheen              = factors2.x;
+    mat.sheenTint          = factors2.y;
+    mat.clearcoat          = factors2.z;
+    mat.clearcoatRoughness = mix(0.1, 0.001, factors2.w); // Remapping from gloss to roughness
+
+    mat.specTrans          = factors3.x;
+    mat.ior                = emissionBIor.y;
+    mat.medium.type        = int((param2.z >> 24) & 0xFu);
+    mat.medium.density     = mediumParams.x;
+
+    mat.medium.color       = vec3(mediumColorRG, mediumColorB.x);
+    mat.medium.anisotropy  = clamp(mediumParams.y, -0.9, 0.9);
+
+    mat.opacity            = factors3.y;
+    mat.alphaMode          = int(param2.z >> 28);
+    mat.alphaCutoff        = factors3.z;
+#else
+    int index = state.matID * 8;
+
     vec4 param1 = texelFetch(materialsTex, ivec2(index + 0, 0), 0);
     vec4 param2 = texelFetch(materialsTex, ivec2(index + 1, 0), 0);
     vec4 param3 = texelFetch(materialsTex, ivec2(index + 2, 0), 0);
@@ -60,16 +106,25 @@ void GetMaterial(inout State state, in Ray r)
     mat.medium.color       = param6.rgb;
     mat.medium.anisotropy  = clamp(param6.w, -0.9, 0.9);
 
-    ivec4 texIDs           = ivec4(param7);
-
     mat.opacity            = param8.x;
     mat.alphaMode          = int(param8.y);
     mat.alphaCutoff        = param8.z;
+#endif
+
+#ifdef OPT_TEXTURES
+#ifdef OPT_PACKED_MATERIALS
+    ivec4 texIDs           = ivec4(UnpackTexIDs(param3.x), UnpackTexIDs(param3.y));
+#else
+    ivec4 texIDs           = ivec4(param7);
+#endif
+
+    // Footprint of the ray cone on the surface
+    float lodBias = state.texLodBias + log2(state.coneWidth / max(abs(dot(state.normal, r.direction)), 1e-4));
 
     // Base Color Map
     if (texIDs.x >= 0)
     {
-        vec4 col = texture(textureMapsArrayTex, vec3(state.texCoord, texIDs.x));
+        vec4 col = SampleTexture(texIDs.x, state.texCoord, lodBias);
         mat.baseColor.rgb *= pow(col.rgb, vec3(2.2));
         mat.opacity *= col.a;
     }
@@ -77,7 +132,7 @@ void GetMaterial(inout State state, in Ray r)
     // Metallic Roughness Map
     if (texIDs.y >= 0)
     {
-        vec2 matRgh = texture(textureMapsArrayTex, vec3(state.texCoord, texIDs.y)).bg;
+        vec2 matRgh = SampleTexture(texIDs.y, state.texCoord, lodBias).bg;
         mat.metallic = matRgh.x;
         mat.roughness = max(matRgh.y * matRgh.y, 0.001);
     }
@@ -85,17 +140,22 @@ void GetMaterial(inout State state, in Ray r)
     // Normal Map
     if (texIDs.z >= 0)
     {
-        vec3 texNormal = texture(textureMapsArrayTex, vec3(state.texCoord, texIDs.z)).rgb;
+        // Only XY is stored, Z is reconstructed
+        vec3 texNormal;
+        texNormal.xy = SampleTexture(texIDs.z, state.texCoord, lodBias).rg;
 
 #ifdef OPT_OPENGL_NORMALMAP
         texNormal.y = 1.0 - texNormal.y;
 #endif
-        texNormal = normalize(texNormal * 2.0 - 1.0);
+        texNormal.xy = texNormal.xy * 2.0 - 1.0;
+        texNormal.z = sqrt(max(0.0, 1.0 - dot(texNormal.xy, texNormal.xy)));
+        texNormal = normalize(texNormal);
 
         vec3 origNormal = state.normal;
         state.normal = normalize(state.tangent * texNormal.x + state.bitangent * texNormal.y + state.normal * texNormal.z);
         state.ffnormal = dot(origNormal, r.direction) <= 0.0 ? state.normal : -state.normal;
     }
+#endif
 
 #ifdef OPT_ROUGHNESS_MOLLIFICATION
     if(state.depth > 0)
@@ -103,12 +163,19 @@ void GetMaterial(inout State state, in Ray r)
 #endif
 
     // Emission Map
+#ifdef OPT_TEXTURES
     if (texIDs.w >= 0)
-        mat.emission = pow(texture(textureMapsArrayTex, vec3(state.texCoord, texIDs.w)).rgb, vec3(2.2));
+        mat.emission = pow(SampleTexture(texIDs.w, state.texCoord, lodBias).rgb, vec3(2.2));
+#endif
 
+#ifdef OPT_ANISO
     float aspect = sqrt(1.0 - mat.anisotropic * 0.9);
     mat.ax = max(0.001, mat.roughness / aspect);
     mat.ay = max(0.001, mat.roughness * aspect);
+#else
+    mat.ax = max(0.001, mat.roughness);
+    mat.ay = mat.ax;
+#endif
 
     state.mat = mat;
     state.eta = dot(r.direction, state.normal) < 0.0 ? (1.0 / mat.ior) : mat.ior;
@@ -122,6 +189,9 @@ vec3 EvalTransmittance(Ray r)
     State state;
     vec3 transmittance = vec3(1.0);
 
+    state.coneWidth = 0.0;
+    state.coneSpread = 0.0;
+
     for (int depth = 0; depth < maxDepth; depth++)
     {
         bool hit = ClosestHit(r, state, lightSample);
@@ -134,7 +204,11 @@ vec3 EvalTransmittance(Ray r)
         GetMaterial(state, r);
 
         bool alphatest = (state.mat.alphaMode == ALPHA_MODE_MASK && state.mat.opacity < state.mat.alphaCutoff) || (state.mat.alphaMode == ALPHA_MODE_BLEND && rand() > state.mat.opacity);
+#ifdef OPT_SPEC_TRANS
         bool refractive = (1.0 - state.mat.metallic) * state.mat.specTrans > 0.0;
+#else
+        bool refractive = false;
+#endif
 
         // Refraction is ignored (Not physically correct but helps with sampling lights from inside refractive objects)
         if(hit && !(alphatest || refractive))
@@ -179,7 +253,12 @@ vec3 DirectLight(in Ray r, in State state, bool isSurface)
         Li *= EvalTransmittance(shadowRay);
 
         if (isSurface)
+        {
             scatterSample.f = DisneyEval(state, -r.direction, state.ffnormal, lightDir, scatterSample.pdf);
+#ifdef OPT_GUIDING
+            scatterSample.pdf = GuidedPdf(scatterSample.pdf, lightDir);
+#endif
+        }
         else
         {
             float p = PhaseHG(dot(-r.direction, lightDir), state.medium.anisotropy);
@@ -200,6 +279,9 @@ vec3 DirectLight(in Ray r, in State state, bool isSurface)
         if (!inShadow)
         {
             scatterSample.f = DisneyEval(state, -r.direction, state.ffnormal, lightDir, scatterSample.pdf);
+#ifdef OPT_GUIDING
+            scatterSample.pdf = GuidedPdf(scatterSample.pdf, lightDir);
+#endif
 
             if (scatterSample.pdf > 0.0)
             {
@@ -220,7 +302,7 @@ vec3 DirectLight(in Ray r, in State state, bool isSurface)
         Light light;
 
         //Pick a light to sample
-        int index = int(rand() * float(numOfLights)) * 5;
+        int index = int(Sample1D(DIM_LIGHT_SELECT) * float(numOfLights)) * 5;
 
         // Fetch light Data
         vec3 position = texelFetch(lightsTex, ivec2(index + 0, 0), 0).xyz;
@@ -245,7 +327,12 @@ vec3 DirectLight(in Ray r, in State state, bool isSurface)
             Li *= EvalTransmittance(shadowRay);
 
             if (isSurface)
+            {
                 scatterSample.f = DisneyEval(state, -r.direction, state.ffnormal, lightSample.direction, scatterSample.pdf);
+#ifdef OPT_GUIDING
+                scatterSample.pdf = GuidedPdf(scatterSample.pdf, lightSample.direction);
+#endif
+            }
             else
             {
                 float p = PhaseHG(dot(-r.direction, lightSample.direction), state.medium.anisotropy);
@@ -266,6 +353,9 @@ vec3 DirectLight(in Ray r, in State state, bool isSurface)
             if (!inShadow)
             {
                 scatterSample.f = DisneyEval(state, -r.direction, state.ffnormal, lightSample.direction, scatterSample.pdf);
+#ifdef OPT_GUIDING
+                scatterSample.pdf = GuidedPdf(scatterSample.pdf, lightSample.direction);
+#endif
 
                 float misWeight = 1.0;
                 if(light.area > 0.0) // No MIS for distant light
@@ -282,6 +372,66 @@ vec3 DirectLight(in Ray r, in State state, bool isSurface)
     return Ld;
 }
 
+#ifdef OPT_DENOISER
+// Albedo and normal of the first visible surface. These are accumulated as auxiliary images for the denoiser
+vec3 firstHitAlbedo;
+vec3 firstHitNormal;
+#endif
+
+#ifdef OPT_GUIDING_TRAIN
+// Surface vertices of the path that train the path guide. The radiance that arrived along the sampled direction
+// is what the path gathered after the vertex, divided by the throughput up to it
+int numGuideVertices;
+vec3 guideVertexPos[OPT_GUIDING_TRAIN];
+vec3 guideVertexDir[OPT_GUIDING_TRAIN];
+vec3 guideVertexRadiance[OPT_GUIDING_TRAIN];
+vec3 guideVertexThroughput[OPT_GUIDING_TRAIN];
+float guideVertexPdf[OPT_GUIDING_TRAIN];
+#endif
+
+#ifdef OPT_EFFICIENCY_RR
+// Weight window of adjoint-driven Russian roulette and splitting (Vorba and Krivanek 2016), relative to the pixel estimate
+#define RR_WINDOW_LOW 0.33
+#define RR_WINDOW_HIGH 1.67
+#define MAX_LIGHT_SPLITS 4
+
+// Estimates are rough, so even the paths that look least important keep this chance of surviving
+#define RR_MIN_SURVIVAL 0.25
+
+// Luminance of the pixel from the completed passes, 0 when there is none yet
+float pixelEstimate = 0.0;
+
+// Paths expected to contribute a lot to their pixel split their light samples rather than the whole path,
+// which a path tracer without a stack can't branch
+int numLightSplits;
+
+vec3 SplitDirectLight(in Ray r, in State state, bool isSurface)
+{
+    vec3 Ld = DirectLight(r, state, isSurface);
+    for (int i = 1; i < numLightSplits; i++)
+    {
+        SetSampleSplit(i);
+        Ld += DirectLight(r, state, isSurface);
+    }
+    SetSampleSplit(0);
+
+    return Ld / float(numLightSplits);
+}
+
+// Radiance the rest of the path is expected to bring back along dir. The path guide distributes what its cell learned
+// the way it guides, but it only learns from surface vertices. Elsewhere the pixel estimate stands in and the window
+// only depends on the throughput
+float VertexRadianceEstimate(vec3 p, vec3 dir, bool onSurface)
+{
+#ifdef OPT_GUIDING
+    int cell = GuideCell(p);
+    if (onSurface && GuideTrained(cell))
+        return GuideIrradiance(cell) * GuidePdf(cell, dir);
+#endif
+    return pixelEstimate;
+}
+#endif
+
 vec4 PathTrace(Ray r)
 {
     vec3 radiance = vec3(0.0);
@@ -298,8 +448,27 @@ vec4 PathTrace(Ray r)
     bool mediumSampled = false;
     bool surfaceScatter = false;
 
+    // Primary rays start as a cone with the spread angle of a pixel
+    state.coneWidth = 0.0;
+    state.coneSpread = atan(2.0 * tan(camera.fov * 0.5) / resolution.y);
+
+#ifdef OPT_DENOISER
+    firstHitAlbedo = vec3(0.0);
+    firstHitNormal = vec3(0.0);
+#endif
+
+#ifdef OPT_GUIDING_TRAIN
+    numGuideVertices = 0;
+#endif
+
+#ifdef OPT_EFFICIENCY_RR
+    numLightSplits = 1;
+#endif
+
     for (state.depth = 0;; state.depth++)
     {
+        SetSampleBounce(state.depth);
+
         bool hit = ClosestHit(r, state, lightSample);
 
         if (!hit)
@@ -335,11 +504,28 @@ vec4 PathTrace(Ray r)
 #endif
 #endif
              }
+
+#ifdef OPT_DENOISER
+             // The environment seen directly acts as the albedo of the background
+             if (state.depth == 0)
+                 firstHitAlbedo = min(radiance, vec3(1.0));
+#endif
              break;
         }
 
+        state.coneWidth += state.coneSpread * state.hitDist;
+
         GetMaterial(state, r);
 
+#ifdef OPT_DENOISER
+        // Glass shows what is behind it, so it is treated as white
+        if (state.depth == 0)
+        {
+            firstHitAlbedo = mix(state.mat.baseColor, vec3(1.0), state.mat.specTrans);
+            firstHitNormal = state.ffnormal;
+        }
+#endif
+
         // Gather radiance from emissive objects. Emission from meshes is not importance sampled
         radiance += state.mat.emission * throughput;
         
@@ -387,7 +573,7 @@ vec4 PathTrace(Ray r)
             else
             {
                 // Sample a distance in the medium
-                float scatterDist = min(-log(rand()) / state.medium.density, state.hitDist);
+                float scatterDist = min(-log(Sample1D(DIM_MEDIUM_DIST)) / state.medium.density, state.hitDist);
                 mediumSampled = scatterDist < state.hitDist;
 
                 if (mediumSampled)
@@ -399,10 +585,15 @@ vec4 PathTrace(Ray r)
                     state.fhp = r.origin;
 
                     // Transmittance Evaluation
+#ifdef OPT_EFFICIENCY_RR
+                    radiance += SplitDirectLight(r, state, false) * throughput;
+#else
                     radiance += DirectLight(r, state, false) * throughput;
+#endif
 
                     // Pick a new direction based on the phase function
-                    vec3 scatterDir = SampleHG(-r.direction, state.medium.anisotropy, rand(), rand());
+                    vec2 phaseSample = Sample2D(DIM_BSDF);
+                    vec3 scatterDir = SampleHG(-r.direction, state.medium.anisotropy, phaseSample.x, phaseSample.y);
                     scatterSample.pdf = PhaseHG(dot(-r.direction, scatterDir), state.medium.anisotropy);
                     r.direction = scatterDir;
                 }
@@ -427,15 +618,56 @@ vec4 PathTrace(Ray r)
             {
                 surfaceScatter = true;
 
+#ifdef OPT_GUIDING
+                // One-sample MIS between the learned distribution and the BSDF. Near specular and transmissive
+                // surfaces are left to the BSDF, as are cells that haven't learned anything yet
+                guideCell = GuideCell(state.fhp);
+                guideProb = (state.mat.roughness > 0.1 && state.mat.specTrans == 0.0 && GuideTrained(guideCell)) ? 0.5 : 0.0;
+#endif
+
                 // Next event estimation
+#ifdef OPT_EFFICIENCY_RR
+                radiance += SplitDirectLight(r, state, true) * throughput;
+#else
                 radiance += DirectLight(r, state, true) * throughput;
+#endif
 
+#ifdef OPT_GUIDING
+                if (guideProb > 0.0 && Sample1D(DIM_GUIDE) < guideProb)
+                {
+                    float guidePdf, bsdfPdf;
+                    scatterSample.L = SampleGuide(guideCell, Sample2D(DIM_BSDF), guidePdf);
+                    scatterSample.f = DisneyEval(state, -r.direction, state.ffnormal, scatterSample.L, bsdfPdf);
+                    scatterSample.pdf = bsdfPdf > 0.0 ? mix(bsdfPdf, guidePdf, guideProb) : 0.0;
+                }
+                else
+                {
+                    scatterSample.f = DisneySample(state, -r.direction, state.ffnormal, scatterSample.L, scatterSample.pdf);
+                    scatterSample.pdf = GuidedPdf(scatterSample.pdf, scatterSample.L);
+                }
+#else
                 // Sample BSDF for color and outgoing direction
                 scatterSample.f = DisneySample(state, -r.direction, state.ffnormal, scatterSample.L, scatterSample.pdf);
+#endif
                 if (scatterSample.pdf > 0.0)
                     throughput *= scatterSample.f / scatterSample.pdf;
                 else
                     break;
+
+#ifdef OPT_GUIDING_TRAIN
+                if (numGuideVertices < OPT_GUIDING_TRAIN)
+                {
+                    guideVertexPos[numGuideVertices] = state.fhp;
+                    guideVertexDir[numGuideVertices] = scatterSample.L;
+                    guideVertexRadiance[numGuideVertices] = radiance;
+                    guideVertexThroughput[numGuideVertices] = throughput;
+                    guideVertexPdf[numGuideVertices] = scatterSample.pdf;
+                    numGuideVertices++;
+                }
+#endif
+
+                // Widen the ray cone by the apex angle of a cone with the solid angle of the sample (1 / pdf)
+                state.coneSpread = min(state.coneSpread + 2.0 * sqrt(INV_PI / scatterSample.pdf), PI);
             }
 
             // Move ray origin to hit point and set direction for next bounce
@@ -463,10 +695,30 @@ vec4 PathTrace(Ray r)
         // Russian roulette
         if (state.depth >= OPT_RR_DEPTH)
         {
-            float q = min(max(throughput.x, max(throughput.y, throughput.z)) + 0.001, 0.95);
-            if (rand() > q)
-                break;
-            throughput /= q;
+#ifdef OPT_EFFICIENCY_RR
+            if (pixelEstimate > 0.0)
+            {
+                // Expected contribution of the rest of the path relative to the pixel. Paths below the window survive with the
+                // probability that brings them into it, paths above it take more light samples at the following vertices
+                float ratio = Luminance(throughput) * VertexRadianceEstimate(state.fhp, r.direction, !mediumSampled) / pixelEstimate;
+                numLightSplits = clamp(int(ceil(ratio / RR_WINDOW_HIGH)), 1, MAX_LIGHT_SPLITS);
+
+                if (ratio < RR_WINDOW_LOW)
+                {
+                    float q = max(ratio / RR_WINDOW_LOW, RR_MIN_SURVIVAL);
+                    if (Sample1D(DIM_RR) >= q)
+                        break;
+                    throughput /= q;
+                }
+            }
+            else
+#endif
+            {
+                float q = min(max(throughput.x, max(throughput.y, throughput.z)) + 0.001, 0.95);
+                if (Sample1D(DIM_RR) > q)
+                    break;
+                throughput /= q;
+            }
         }
 #endif
 
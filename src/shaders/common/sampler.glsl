@@ -0,0 +1,167 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Sample generation for the path tracer. Every random decision of a path uses its own dimension, so that low discrepancy
+// sequences stratify camera, light and BSDF samples independently. Dimensions come in pairs backed by a 2D sequence,
+// decisions that are not worth a dimension (alpha blending, shadow rays through media) still use rand()
+
+// Camera dimensions
+#define DIM_PIXEL 0          // 2D
+#define DIM_LENS 2           // 2D
+#define NUM_CAMERA_DIMS 4
+
+// Dimensions of a bounce, relative to the first dimension of the bounce
+#define DIM_LIGHT 0          // 2D
+#define DIM_BSDF 2           // 2D, also the phase function direction of a volume scatter
+#define DIM_LIGHT_SELECT 4
+#define DIM_BSDF_LOBE 5
+#define DIM_RR 6
+#define DIM_ENVMAP 7
+#define DIM_GUIDE 8          // Choice between path guiding and BSDF sampling
+#define DIM_MEDIUM_DIST 9    // Free flight distance in a medium, must not share the lobe dimension of the surface it may reach
+#define NUM_BOUNCE_DIMS 10
+
+int sampleNum;
+int bounceDim;
+int sampleSplit;
+
+#if defined(OPT_SOBOL) || defined(OPT_BLUE_NOISE)
+uint pixelHash;
+
+#ifdef OPT_BLUE_NOISE
+// Tileable blue noise ranks, two independent ones per texel
+uniform sampler2D blueNoiseTex;
+#endif
+
+uint HashUint(uint x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+uint ReverseBits(uint x)
+{
+    x = ((x & 0xaaaaaaaau) >> 1u) | ((x & 0x55555555u) << 1u);
+    x = ((x & 0xccccccccu) >> 2u) | ((x & 0x33333333u) << 2u);
+    x = ((x & 0xf0f0f0f0u) >> 4u) | ((x & 0x0f0f0f0fu) << 4u);
+    x = ((x & 0xff00ff00u) >> 8u) | ((x & 0x00ff00ffu) << 8u);
+    return (x >> 16u) | (x << 16u);
+}
+
+// Owen scrambling from "Practical Hash-based Owen Scrambling" (Burley 2020)
+uint LaineKarrasPermutation(uint x, uint seed)
+{
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16u) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return x;
+}
+
+uint NestedUniformScramble(uint x, uint seed)
+{
+    return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+}
+
+// Second dimension of the Sobol sequence, the first one is the index with its bits reversed
+uint Sobol1(uint index)
+{
+    uint result = 0u;
+    for (uint v = 1u << 31u; index != 0u; index >>= 1u, v ^= v >> 1u)
+    {
+        if ((index & 1u) != 0u)
+            result ^= v;
+    }
+    return result;
+}
+
+vec2 SobolSample2D(int pair)
+{
+    // Each pair of dimensions shuffles the sample order, which decorrelates the pairs that share the same 2D sequence
+    uint seed = HashUint(pixelHash ^ HashUint(uint(pair)));
+    uint index = NestedUniformScramble(uint(sampleNum), seed);
+    uint x = NestedUniformScramble(ReverseBits(index), HashUint(seed ^ 0xa511e9b3u));
+    uint y = NestedUniformScramble(Sobol1(index), HashUint(seed ^ 0x63d83595u));
+    vec2 s = vec2(x >> 8u, y >> 8u) / 16777216.0;
+
+#ifdef OPT_BLUE_NOISE
+    // Every pixel shifts the same sequence by blue noise, so the error of neighbouring pixels is spread out in screen space
+    ivec2 offset = ivec2(fract(vec2(0.7548776662, 0.5698402910) * float(pair)) * 64.0);
+    s = fract(s + texelFetch(blueNoiseTex, (pixel + offset) & 63, 0).rg);
+#endif
+
+    return s;
+}
+#endif
+
+void InitSampler(vec2 p, int index)
+{
+    InitRNG(p, index);
+    sampleNum = index;
+    bounceDim = 0;
+    sampleSplit = 0;
+#if defined(OPT_SOBOL)
+    pixelHash = HashUint(uint(p.x) ^ HashUint(uint(p.y)));
+#elif defined(OPT_BLUE_NOISE)
+    pixelHash = 0u;
+#endif
+}
+
+void SetSampleBounce(int depth)
+{
+    bounceDim = NUM_CAMERA_DIMS + depth * NUM_BOUNCE_DIMS;
+}
+
+// Splits of a sample past the first one draw independent random numbers, the sequence only has one point per sample
+void SetSampleSplit(int split)
+{
+    sampleSplit = split;
+}
+
+vec2 Sample2D(int dim)
+{
+#if defined(OPT_SOBOL) || defined(OPT_BLUE_NOISE)
+    if (sampleSplit == 0)
+        return SobolSample2D((bounceDim + dim) >> 1);
+#endif
+    return vec2(rand(), rand());
+}
+
+float Sample1D(int dim)
+{
+#if defined(OPT_SOBOL) || defined(OPT_BLUE_NOISE)
+    if (sampleSplit == 0)
+    {
+        dim += bounceDim;
+        vec2 s = SobolSample2D(dim >> 1);
+        return (dim & 1) == 0 ? s.x : s.y;
+    }
+#endif
+    return rand();
+}
@@ -185,8 +185,9 @@ void Onb(in vec3 N, inout vec3 T, inout vec3 B)
 
 void SampleSphereLight(in Light light, in vec3 scatterPos, inout LightSampleRec lightSample)
 {
-    float r1 = rand();
-    float r2 = rand();
+    vec2 r = Sample2D(DIM_LIGHT);
+    float r1 = r.x;
+    float r2 = r.y;
 
     vec3 sphereCentertoSurface = scatterPos - light.position;
     float distToSphereCenter = length(sphereCentertoSurface);
@@ -213,8 +214,9 @@ void SampleSphereLight(in Light light, in vec3 scatterPos, inout LightSampleRec
 
 void SampleRectLight(in Light light, in vec3 scatterPos, inout LightSampleRec lightSample)
 {
-    float r1 = rand();
-    float r2 = rand();
+    vec2 r = Sample2D(DIM_LIGHT);
+    float r1 = r.x;
+    float r2 = r.y;
 
     vec3 lightSurfacePos = light.position + light.u * r1 + light.v * r2;
     lightSample.direction = lightSurfacePos - scatterPos;
@@ -0,0 +1,82 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Normal and metallic-roughness maps live in a two channel atlas (see TexMapType)
+#define COLOR_MAP 0
+#define METALLIC_ROUGHNESS_MAP 2
+
+vec4 SampleAtlas(vec4 info, vec2 coord)
+{
+    if (int(info.w) == COLOR_MAP)
+        return textureLod(textureMapsArrayTex, vec3(coord, info.x), 0.0);
+
+    vec4 col = vec4(textureLod(textureMapsRGArrayTex, vec3(coord, info.x), 0.0).rg, 0.0, 1.0);
+
+    // Metallic and roughness are stored in RG but read from BG
+    if (int(info.w) == METALLIC_ROUGHNESS_MAP)
+        col = col.bgra;
+
+    return col;
+}
+
+vec4 SampleTextureRect(int rectID, vec2 uv)
+{
+    // Textures are packed into atlas pages, so wrap the coords before mapping them onto the rect
+    vec4 rect = texelFetch(textureRectsTex, ivec2(rectID * 2, 0), 0);
+    vec4 info = texelFetch(textureRectsTex, ivec2(rectID * 2 + 1, 0), 0);
+    return SampleAtlas(info, rect.xy + fract(uv) * rect.zw);
+}
+
+// Trilinear lookup into the mip chain of a texture. lodBias is the texture independent part of the ray cone LOD
+// See: Texture Level of Detail Strategies for Real-Time Ray Tracing (Ray Tracing Gems, Chapter 20)
+vec4 SampleTexture(int texID, vec2 uv, float lodBias)
+{
+    vec4 rect = texelFetch(textureRectsTex, ivec2(texID * 2, 0), 0);
+    vec4 info = texelFetch(textureRectsTex, ivec2(texID * 2 + 1, 0), 0);
+    int numLevels = int(info.y);
+    int firstMip = int(info.z);
+
+    // Both atlases have the same page size
+    vec2 pageSize = vec2(int(info.w) == COLOR_MAP ? textureSize(textureMapsArrayTex, 0).xy : textureSize(textureMapsRGArrayTex, 0).xy);
+    vec2 texSize = rect.zw * pageSize;
+    float lod = clamp(lodBias + 0.5 * log2(texSize.x * texSize.y), 0.0, float(numLevels - 1));
+    int level = int(lod);
+    float t = lod - float(level);
+
+    // Level 0 is the rect fetched above, the smaller levels follow each other from firstMip
+    vec4 col;
+    if (level == 0)
+        col = SampleAtlas(info, rect.xy + fract(uv) * rect.zw);
+    else
+        col = SampleTextureRect(firstMip + level - 1, uv);
+    if (t > 0.0)
+        col = mix(col, SampleTextureRect(firstMip + level, uv), t);
+
+    return col;
+}
+
+vec4 SampleTexture(int texID, vec2 uv)
+{
+    return SampleTextureRect(texID, uv);
+}
@@ -22,32 +22,65 @@
  * SOFTWARE.
  */
 
+struct Camera
+{
+    vec3 up;
+    vec3 right;
+    vec3 forward;
+    vec3 position;
+    float fov;
+    float focalDist;
+    float aperture;
+};
+
+// Per frame state shared by the path tracing programs. The renderer writes it once per frame
+// from a struct with the same std140 layout (FrameUniforms in Renderer.cpp)
+layout(std140) uniform FrameUniforms
+{
+    Camera camera;
+    vec3 uniformLightCol;
+    float envMapIntensity;
+    float envMapRot;
+    float roughnessMollificationAmt;
+    int samplesPerPass;
+    bool usePixelEstimate;
+};
+
 uniform bool isCameraMoving;
 uniform vec3 randomVector;
 uniform vec2 resolution;
 uniform vec2 tileOffset;
 uniform vec2 invNumTiles;
 
-uniform sampler2D accumTexture;
 uniform samplerBuffer BVH;
 uniform isamplerBuffer vertexIndicesTex;
 uniform samplerBuffer verticesTex;
 uniform samplerBuffer normalsTex;
+#ifdef OPT_PACKED_MATERIALS
+uniform usampler2D materialsTex;
+#else
 uniform sampler2D materialsTex;
+#endif
 uniform sampler2D transformsTex;
 uniform sampler2D lightsTex;
 uniform sampler2DArray textureMapsArrayTex;
+uniform sampler2DArray textureMapsRGArrayTex;
+uniform sampler2D textureRectsTex;
 
 uniform sampler2D envMapTex;
 uniform sampler2D envMapCDFTex;
 
 uniform vec2 envMapRes;
 uniform float envMapTotalSum;
-uniform float envMapIntensity;
-uniform float envMapRot;
-uniform vec3 uniformLightCol;
 uniform int numOfLights;
 uniform int maxDepth;
 uniform int topBVHIndex;
-uniform int frameNum;
-uniform float roughnessMollificationAmt;
\ No newline at end of file
+uniform int sampleIndex; // Index of the first sample of the current pass
+
+#ifdef OPT_ADAPTIVE
+uniform sampler2D pixelConvergenceTexture;
+#endif
+
+#ifdef OPT_EFFICIENCY_RR
+uniform sampler2D pixelEstimateTexture; // Linear image of the completed passes
+#endif
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#version 330
+
+out vec4 outCol;
+in vec2 TexCoords;
+
+uniform sampler2D accumTexture;
+uniform sampler2D accumMomentsTexture;
+uniform float noiseThreshold;
+uniform int adaptiveMinSpp;
+
+#include common/globals.glsl
+
+// Moments hold the summed squared luminance and the number of samples of a pixel.
+// A pixel has converged once the standard error of its mean, relative to the
+// square root of the mean to favour dark regions less, drops below noiseThreshold
+void main()
+{
+    ivec2 texCoord = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumTexture, texCoord, 0);
+    vec2 moments = texelFetch(accumMomentsTexture, texCoord, 0).xy;
+
+    float n = moments.y;
+    if (n < float(adaptiveMinSpp))
+    {
+        outCol = vec4(0.0);
+        return;
+    }
+
+    float mean = Luminance(accum.rgb) / n;
+    float variance = max(moments.x / n - mean * mean, 0.0) * n / (n - 1.0);
+    float error = sqrt(variance / n) / sqrt(max(mean, 1e-4));
+
+    outCol = vec4(error < noiseThreshold ? 1.0 : 0.0);
+}
@@ -0,0 +1,91 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#version 330
+
+// Training paths for the path guide. Each path writes its first OPT_GUIDING_TRAIN surface vertices
+// as two records: the position, and the sampled direction with the radiance that arrived along it over its pdf
+layout(location = 0) out vec4 records[OPT_GUIDING_TRAIN * 2];
+in vec2 TexCoords;
+
+#include common/uniforms.glsl
+#include common/globals.glsl
+#include common/sampler.glsl
+#include common/texture.glsl
+#include common/intersection.glsl
+#include common/sampling.glsl
+#include common/guiding.glsl
+#include common/envmap.glsl
+#include common/anyhit.glsl
+#include common/closest_hit.glsl
+#include common/disney.glsl
+#include common/lambert.glsl
+#include common/pathtrace.glsl
+
+void main(void)
+{
+    InitSampler(gl_FragCoord.xy, sampleIndex);
+
+    vec2 pixelSample = Sample2D(DIM_PIXEL);
+    float r1 = 2.0 * pixelSample.x;
+    float r2 = 2.0 * pixelSample.y;
+
+    vec2 jitter;
+    jitter.x = r1 < 1.0 ? sqrt(r1) - 1.0 : 1.0 - sqrt(2.0 - r1);
+    jitter.y = r2 < 1.0 ? sqrt(r2) - 1.0 : 1.0 - sqrt(2.0 - r2);
+
+    jitter /= (resolution * 0.5);
+    vec2 d = (2.0 * TexCoords - 1.0) + jitter;
+
+    float scale = tan(camera.fov * 0.5);
+    d.y *= resolution.y / resolution.x * scale;
+    d.x *= scale;
+    vec3 rayDir = normalize(d.x * camera.right + d.y * camera.up + camera.forward);
+
+    vec3 focalPoint = camera.focalDist * rayDir;
+    vec2 lensSample = Sample2D(DIM_LENS);
+    float cam_r1 = lensSample.x * TWO_PI;
+    float cam_r2 = lensSample.y * camera.aperture;
+    vec3 randomAperturePos = (cos(cam_r1) * camera.right + sin(cam_r1) * camera.up) * sqrt(cam_r2);
+    vec3 finalRayDir = normalize(focalPoint - randomAperturePos);
+
+    Ray ray = Ray(camera.position + randomAperturePos, finalRayDir);
+
+    vec3 pathRadiance = PathTrace(ray).rgb;
+
+    for (int i = 0; i < OPT_GUIDING_TRAIN; i++)
+    {
+        if (i < numGuideVertices)
+        {
+            vec3 Li = (pathRadiance - guideVertexRadiance[i]) / max(guideVertexThroughput[i], vec3(1e-6));
+            records[i * 2] = vec4(guideVertexPos[i], 1.0);
+            records[i * 2 + 1] = vec4(guideVertexDir[i], Luminance(Li) / guideVertexPdf[i]);
+        }
+        else
+        {
+            records[i * 2] = vec4(0.0);
+            records[i * 2 + 1] = vec4(0.0);
+        }
+    }
+}
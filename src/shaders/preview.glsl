@@ -27,10 +27,18 @@
 out vec4 color;
 in vec2 TexCoords;
 
+// Upsampled result of the previous preview level and the fraction of the texture being rendered to
+uniform sampler2D previewHistoryTexture;
+uniform float previewHistoryWeight;
+uniform vec2 previewScale;
+
 #include common/uniforms.glsl
 #include common/globals.glsl
+#include common/sampler.glsl
+#include common/texture.glsl
 #include common/intersection.glsl
 #include common/sampling.glsl
+#include common/guiding.glsl
 #include common/envmap.glsl
 #include common/anyhit.glsl
 #include common/closest_hit.glsl
@@ -40,10 +48,11 @@ in vec2 TexCoords;
 
 void main(void)
 {
-    InitRNG(gl_FragCoord.xy, 1);
+    InitSampler(gl_FragCoord.xy, 1);
 
-    float r1 = 2.0 * rand();
-    float r2 = 2.0 * rand();
+    vec2 pixelSample = Sample2D(DIM_PIXEL);
+    float r1 = 2.0 * pixelSample.x;
+    float r2 = 2.0 * pixelSample.y;
 
     vec2 jitter;
     jitter.x = r1 < 1.0 ? sqrt(r1) - 1.0 : 1.0 - sqrt(2.0 - r1);
@@ -58,8 +67,9 @@ void main(void)
     vec3 rayDir = normalize(d.x * camera.right + d.y * camera.up + camera.forward);
 
     vec3 focalPoint = camera.focalDist * rayDir;
-    float cam_r1 = rand() * TWO_PI;
-    float cam_r2 = rand() * camera.aperture;
+    vec2 lensSample = Sample2D(DIM_LENS);
+    float cam_r1 = lensSample.x * TWO_PI;
+    float cam_r2 = lensSample.y * camera.aperture;
     vec3 randomAperturePos = (cos(cam_r1) * camera.right + sin(cam_r1) * camera.up) * sqrt(cam_r2);
     vec3 finalRayDir = normalize(focalPoint - randomAperturePos);
 
@@ -67,5 +77,8 @@ void main(void)
 
     vec4 pixelColor = PathTrace(ray);
 
+    if (previewHistoryWeight > 0.0)
+        pixelColor = mix(pixelColor, texture(previewHistoryTexture, TexCoords * previewScale), previewHistoryWeight);
+
     color = pixelColor;
 }
\ No newline at end of file
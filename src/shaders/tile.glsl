@@ -24,13 +24,23 @@
 
 #version 330
 
-out vec4 color;
+layout(location = 0) out vec4 color;
+#ifdef OPT_ADAPTIVE
+layout(location = 1) out vec4 moments;
+#endif
+#ifdef OPT_DENOISER
+layout(location = 2) out vec4 albedo;
+layout(location = 3) out vec4 normal;
+#endif
 in vec2 TexCoords;
 
 #include common/uniforms.glsl
 #include common/globals.glsl
+#include common/sampler.glsl
+#include common/texture.glsl
 #include common/intersection.glsl
 #include common/sampling.glsl
+#include common/guiding.glsl
 #include common/envmap.glsl
 #include common/anyhit.glsl
 #include common/closest_hit.glsl
@@ -42,34 +52,73 @@ void main(void)
 {
     vec2 coordsTile = mix(tileOffset, tileOffset + invNumTiles, TexCoords);
 
-    InitRNG(gl_FragCoord.xy, frameNum);
+#ifdef OPT_ADAPTIVE
+    // Converged pixels keep their accumulated result and sample count
+    if (texture(pixelConvergenceTexture, coordsTile).r != 0.0)
+        discard;
+#endif
 
-    float r1 = 2.0 * rand();
-    float r2 = 2.0 * rand();
+    vec4 pixelColor = vec4(0.0);
+    float lumSqr = 0.0;
+#ifdef OPT_DENOISER
+    vec3 albedoSum = vec3(0.0);
+    vec3 normalSum = vec3(0.0);
+#endif
 
-    vec2 jitter;
-    jitter.x = r1 < 1.0 ? sqrt(r1) - 1.0 : 1.0 - sqrt(2.0 - r1);
-    jitter.y = r2 < 1.0 ? sqrt(r2) - 1.0 : 1.0 - sqrt(2.0 - r2);
+#ifdef OPT_EFFICIENCY_RR
+    if (usePixelEstimate)
+        pixelEstimate = Luminance(texelFetch(pixelEstimateTexture, ivec2(gl_FragCoord.xy), 0).rgb);
+#endif
 
-    jitter /= (resolution * 0.5);
-    vec2 d = (coordsTile * 2.0 - 1.0) + jitter;
+    for (int i = 0; i < samplesPerPass; i++)
+    {
+        // Seeded by the pixel and the sample index, so a sample doesn't depend on which tile or process rendered it
+        InitSampler(gl_FragCoord.xy, sampleIndex + i);
 
-    float scale = tan(camera.fov * 0.5);
-    d.y *= resolution.y / resolution.x * scale;
-    d.x *= scale;
-    vec3 rayDir = normalize(d.x * camera.right + d.y * camera.up + camera.forward);
+        vec2 pixelSample = Sample2D(DIM_PIXEL);
+        float r1 = 2.0 * pixelSample.x;
+        float r2 = 2.0 * pixelSample.y;
 
-    vec3 focalPoint = camera.focalDist * rayDir;
-    float cam_r1 = rand() * TWO_PI;
-    float cam_r2 = rand() * camera.aperture;
-    vec3 randomAperturePos = (cos(cam_r1) * camera.right + sin(cam_r1) * camera.up) * sqrt(cam_r2);
-    vec3 finalRayDir = normalize(focalPoint - randomAperturePos);
+        vec2 jitter;
+        jitter.x = r1 < 1.0 ? sqrt(r1) - 1.0 : 1.0 - sqrt(2.0 - r1);
+        jitter.y = r2 < 1.0 ? sqrt(r2) - 1.0 : 1.0 - sqrt(2.0 - r2);
 
-    Ray ray = Ray(camera.position + randomAperturePos, finalRayDir);
+        jitter /= (resolution * 0.5);
+        vec2 d = (coordsTile * 2.0 - 1.0) + jitter;
 
-    vec4 accumColor = texture(accumTexture, coordsTile);
+        float scale = tan(camera.fov * 0.5);
+        d.y *= resolution.y / resolution.x * scale;
+        d.x *= scale;
+        vec3 rayDir = normalize(d.x * camera.right + d.y * camera.up + camera.forward);
 
-    vec4 pixelColor = PathTrace(ray);
+        vec3 focalPoint = camera.focalDist * rayDir;
+        vec2 lensSample = Sample2D(DIM_LENS);
+        float cam_r1 = lensSample.x * TWO_PI;
+        float cam_r2 = lensSample.y * camera.aperture;
+        vec3 randomAperturePos = (cos(cam_r1) * camera.right + sin(cam_r1) * camera.up) * sqrt(cam_r2);
+        vec3 finalRayDir = normalize(focalPoint - randomAperturePos);
 
-    color = pixelColor + accumColor;
-}
\ No newline at end of file
+        Ray ray = Ray(camera.position + randomAperturePos, finalRayDir);
+
+        vec4 sampleColor = PathTrace(ray);
+        pixelColor += sampleColor;
+        float lum = Luminance(sampleColor.rgb);
+        lumSqr += lum * lum;
+#ifdef OPT_DENOISER
+        albedoSum += firstHitAlbedo;
+        normalSum += firstHitNormal;
+#endif
+    }
+
+    // Outputs are added to the accumulation buffers by blending
+    color = pixelColor;
+
+#ifdef OPT_ADAPTIVE
+    moments = vec4(lumSqr, float(samplesPerPass), 0.0, 0.0);
+#endif
+
+#ifdef OPT_DENOISER
+    albedo = vec4(albedoSum, 0.0);
+    normal = vec4(normalSum, 0.0);
+#endif
+}
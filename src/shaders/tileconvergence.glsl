@@ -0,0 +1,54 @@
+/*
+ * MIT License
+ *
+ * Copyright(c) 2019 Asif Ali
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#version 330
+
+out vec4 outCol;
+in vec2 TexCoords;
+
+uniform sampler2D pixelConvergenceTexture;
+uniform ivec2 tileSize;
+
+// Rendered at one fragment per tile. Writes 1 when every pixel of the tile has converged
+void main()
+{
+    ivec2 tileStart = ivec2(gl_FragCoord.xy) * tileSize;
+    ivec2 texSize = textureSize(pixelConvergenceTexture, 0);
+
+    for (int y = 0; y < tileSize.y; y++)
+    {
+        for (int x = 0; x < tileSize.x; x++)
+        {
+            ivec2 texCoord = min(tileStart + ivec2(x, y), texSize - 1);
+            if (texelFetch(pixelConvergenceTexture, texCoord, 0).r == 0.0)
+            {
+                outCol = vec4(0.0);
+                return;
+            }
+        }
+    }
+
+    outCol = vec4(1.0);
+}
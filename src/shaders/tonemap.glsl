@@ -24,7 +24,8 @@
 
 #version 330
 
-out vec4 outCol;
+layout(location = 0) out vec4 outCol;
+layout(location = 1) out vec4 outHDRCol;
 in vec2 TexCoords;
 
 uniform sampler2D pathTraceTexture;
@@ -33,6 +34,13 @@ uniform bool enableTonemap;
 uniform bool enableAces;
 uniform bool simpleAcesFit;
 uniform vec3 backgroundCol;
+uniform vec2 texCoordScale;
+
+#ifdef OPT_ADAPTIVE
+// Pixels stop accumulating at different sample counts, which the moments texture keeps track of
+uniform sampler2D accumMomentsTexture;
+uniform bool usePixelSampleCount;
+#endif
 
 #include common/globals.glsl
 
@@ -96,10 +104,17 @@ vec3 Tonemap(in vec3 c, float limit)
 
 void main()
 {
-    vec4 col = texture(pathTraceTexture, TexCoords) * invSampleCounter;
+    vec4 col = texture(pathTraceTexture, TexCoords * texCoordScale) * invSampleCounter;
+#ifdef OPT_ADAPTIVE
+    if (usePixelSampleCount)
+        col = texture(pathTraceTexture, TexCoords) / max(texture(accumMomentsTexture, TexCoords).y, 1.0);
+#endif
     vec3 color = col.rgb;
     float alpha = col.a;
 
+    // Linear output for float image formats
+    outHDRCol = col;
+
     if (enableTonemap)
     {
         if (enableAces)
@@ -53,6 +53,10 @@ namespace RadeonRays
         void ProcessTLAS();
         void UpdateTLAS(const Bvh* topLevelBvh, const std::vector<GLSLPT::MeshInstance>& instances);
         void Process(const Bvh* topLevelBvh, const std::vector<GLSLPT::Mesh*>& meshes, const std::vector<GLSLPT::MeshInstance>& instances);
+        // Root node of each mesh. Needed by UpdateTLAS() when the nodes were restored instead of processed
+        const std::vector<int>& GetBLASRoots() const { return bvhRootStartIndices; }
+        void SetBLASRoots(const std::vector<int>& roots) { bvhRootStartIndices = roots; }
+
         int topLevelIndex = 0;
         std::vector<Node> nodes;
         int nodeTexWidth;